@@ -0,0 +1,218 @@
+#include "affinity.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static uint32_t
+parse_cpu_list(const char* spec, int* cpus, uint32_t max)
+{
+	// Format: "0-3,8,10-11"
+	uint32_t size = 0;
+	const char* p = spec;
+
+	while (*p && *p != '\n') {
+		char* end;
+		long begin = strtol(p, &end, 10);
+
+		if (end == p || begin < 0) {
+			return 0;
+		}
+
+		long last = begin;
+		p = end;
+
+		if (*p == '-') {
+			p++;
+			last = strtol(p, &end, 10);
+
+			if (end == p || last < begin) {
+				return 0;
+			}
+			p = end;
+		}
+
+		for (long cpu = begin; cpu <= last && size < max; cpu++) {
+			cpus[size++] = (int)cpu;
+		}
+
+		if (*p == ',') {
+			p++;
+		}
+		else if (*p && *p != '\n') {
+			return 0;
+		}
+	}
+	return size;
+}
+
+static uint32_t
+read_cpu_list(const char* path, int* cpus, uint32_t max)
+{
+	FILE* fp = fopen(path, "r");
+
+	if (! fp) {
+		return 0;
+	}
+
+	char buf[4096];
+	uint32_t size = 0;
+
+	if (fgets(buf, sizeof(buf), fp)) {
+		size = parse_cpu_list(buf, cpus, max);
+	}
+	fclose(fp);
+	return size;
+}
+
+static bool
+parse_numa(affinity* aff)
+{
+	static int node_cpus[AFFINITY_MAX_CPUS];
+	int nodes[AFFINITY_MAX_CPUS];
+	uint32_t node_count = read_cpu_list("/sys/devices/system/node/online", nodes, AFFINITY_MAX_CPUS);
+
+	if (node_count == 0) {
+		// No NUMA information. Treat machine as a single node.
+		aff->size = read_cpu_list("/sys/devices/system/cpu/online", aff->cpus, AFFINITY_MAX_CPUS);
+		return aff->size > 0;
+	}
+
+	// Read each node's cpus into consecutive ranges of node_cpus.
+	uint32_t offsets[node_count + 1];
+	uint32_t total = 0;
+
+	for (uint32_t i = 0; i < node_count; i++) {
+		char path[128];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", nodes[i]);
+		offsets[i] = total;
+		total += read_cpu_list(path, node_cpus + total, AFFINITY_MAX_CPUS - total);
+	}
+	offsets[node_count] = total;
+
+	// Interleave nodes: first cpu of each node, then second cpu of each node, etc.
+	aff->size = 0;
+
+	for (uint32_t n = 0; aff->size < total; n++) {
+		for (uint32_t i = 0; i < node_count; i++) {
+			if (offsets[i] + n < offsets[i + 1]) {
+				aff->cpus[aff->size++] = node_cpus[offsets[i] + n];
+			}
+		}
+	}
+	return aff->size > 0;
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+bool
+affinity_parse(affinity* aff, const char* spec)
+{
+	if (strcmp(spec, "numa") == 0 || strcmp(spec, "numa=auto") == 0) {
+		return parse_numa(aff);
+	}
+
+	aff->size = parse_cpu_list(spec, aff->cpus, AFFINITY_MAX_CPUS);
+	return aff->size > 0;
+}
+
+int
+affinity_cpu(const affinity* aff, uint32_t index)
+{
+	return aff->cpus[index % aff->size];
+}
+
+int
+affinity_free_cpu(const affinity* aff, uint32_t loop_count)
+{
+	int online[AFFINITY_MAX_CPUS];
+	uint32_t online_count = read_cpu_list("/sys/devices/system/cpu/online", online, AFFINITY_MAX_CPUS);
+	uint32_t used = loop_count < aff->size ? loop_count : aff->size;
+
+	for (uint32_t i = 0; i < online_count; i++) {
+		bool found = false;
+
+		for (uint32_t j = 0; j < used; j++) {
+			if (aff->cpus[j] == online[i]) {
+				found = true;
+				break;
+			}
+		}
+
+		if (! found) {
+			return online[i];
+		}
+	}
+	return -1;
+}
+
+int
+affinity_cpu_node(int cpu)
+{
+	char path[128];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+	DIR* dir = opendir(path);
+
+	if (! dir) {
+		return -1;
+	}
+
+	// Node is exposed as a "nodeN" link in the cpu directory.
+	struct dirent* entry;
+	int node = -1;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+			node = atoi(entry->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+}
+
+bool
+affinity_pin_thread(int cpu)
+{
+#if defined(__linux__)
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+#else
+	// Thread affinity is not supported on this platform.
+	return false;
+#endif
+}
+
+void*
+affinity_alloc_local(size_t size)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	size_t alloc_size = (size + page_size - 1) & ~(page_size - 1);
+	void* p;
+
+	if (posix_memalign(&p, page_size, alloc_size) != 0) {
+		return NULL;
+	}
+
+	// Touch every page from this thread.
+	memset(p, 0, alloc_size);
+	return p;
+}
+
+void
+affinity_free_local(void* p)
+{
+	free(p);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+#define AFFINITY_MAX_CPUS 1024
+
+// Ordered list of cpus that event loop threads are pinned to.
+// Loop i is pinned to cpus[i % size].
+typedef struct {
+	int cpus[AFFINITY_MAX_CPUS];
+	uint32_t size;
+} affinity;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Parse cpu list ("2,4,6-9") or "numa"/"numa=auto". The numa policy spreads
+// loops round-robin across NUMA nodes, one core at a time.
+bool affinity_parse(affinity* aff, const char* spec);
+
+// Return cpu assigned to event loop index.
+int affinity_cpu(const affinity* aff, uint32_t index);
+
+// Return first online cpu not used by any of the loop_count event loops,
+// or -1 if every cpu is taken.
+int affinity_free_cpu(const affinity* aff, uint32_t loop_count);
+
+// Return NUMA node that owns cpu, or -1 if unknown.
+int affinity_cpu_node(int cpu);
+
+// Pin calling thread to cpu.
+bool affinity_pin_thread(int cpu);
+
+// Allocate page aligned, zeroed memory and touch it from the calling thread.
+// With the default first-touch policy, pages land on the caller's NUMA node.
+void* affinity_alloc_local(size_t size);
+
+void affinity_free_local(void* p);
@@ -1,43 +1,232 @@
 #include <aerospike/aerospike.h>
 #include <aerospike/aerospike_batch.h>
 #include <aerospike/aerospike_key.h>
+#include <aerospike/aerospike_scan.h>
+#include <aerospike/as_atomic.h>
+#include <aerospike/as_cluster.h>
 #include <aerospike/as_event.h>
+// Only for as_event_execute(), which runs a callback on a given loop's
+// thread. as_event.h has no public equivalent, and the main, producer and
+// export threads need it to start, drain and resume loops. Everything else
+// uses the public as_event.h API.
+#include <aerospike/as_event_internal.h>
 #include <aerospike/as_log.h>
 #include <aerospike/as_monitor.h>
+#include <math.h>
+#include <sched.h>
+#include <signal.h>
+#include <stddef.h>
+#include <sys/resource.h>
 #include <unistd.h>
-
-#if defined(AS_USE_LIBEVENT)
-#include <event.h>
-#if LIBEVENT_VERSION_NUMBER < 0x02010000
-void event_base_add_virtual(struct event_base*);
-#endif
-#endif
+#include "affinity.h"
+#include "backend.h"
+#include "coro.h"
+#include "export.h"
+#include "histogram.h"
+#include "loader.h"
+#include "loop_stats.h"
+#include "loop_timer.h"
+#include "retry.h"
+#include "route.h"
+#include "stats.h"
+#include "submit.h"
+#include "value.h"
+#include "warm_up.h"
+#include "window.h"
 
 /******************************************************************************
  *	Types
  *****************************************************************************/
 
+#define CACHE_LINE_SIZE 64
+#define MAX_BINS 1000
+#define VALUE_COUNT 1024  // Distinct pre-generated values per run.
+#define ASYNC_QUEUE_SIZE 100
+#define PIPELINE_QUEUE_SIZE 1000
+#define MAX_CONNS_PER_LOOP 200
+#define THROTTLE_TICK_US 1000       // Token bucket refill period.
+#define THROTTLE_BURST_NS 10000000  // Token bucket holds at most 10ms of tokens.
+#define EXPORT_BUFFER_SIZE (4 * 1024 * 1024)  // Export writer buffer size, two per loop.
+#define EXPORT_PAGE_RECORDS 10000   // Records per scan page. The scan pauses between pages.
+#define PARTITION_COUNT 4096
+#define RETRY_BASE_US 1000          // Backoff before the first retry, doubled per attempt.
+#define RETRY_MAX_US 1000000        // Backoff cap.
+#define STALL_RETRY_US 1000         // Delay before issuing again after a failed issue left nothing in flight.
+#define HEDGE_WINDOW 1000           // Reads per hedge delay update.
+#define SUBMIT_RING_SIZE 4096       // Submission ring capacity per loop.
+#define SUBMIT_BATCH 64             // Commands popped from the ring at a time.
+
 // External loop definition
 typedef struct {
 	pthread_t thread;
-#if defined(AS_USE_LIBUV)
-	uv_loop_t* uv_loop;
-#elif defined(AS_USE_LIBEVENT)
-	struct event_base* event_loop;
-#else
-	struct ev_loop* ev_loop;
-#endif
+	void* native;
 	as_event_loop* as_loop;
 } loop;
 
+// Fixed-capacity free list of command contexts owned by one event loop.
+// Sized to the largest window, so steady state issue/complete never touches
+// the heap.
+typedef struct {
+	struct command_s* commands;
+	struct command_s* free_list;
+	as_bin_value* values;  // Loader bin values, g_bin_count per command. Loader mode only.
+	uint32_t capacity;
+} command_pool;
+
+// Loop shutdown state. A running loop drains once shutdown begins, and
+// closes from its own thread when nothing it issued is still in flight.
+typedef enum {
+	LOOP_RUNNING,
+	LOOP_DRAINING,
+	LOOP_CLOSED
+} loop_state;
+
+// Counter shard owned by a single event loop. Each shard is only accessed from
+// its own event loop thread, so no atomics are needed. Shards are aligned to a
+// cache line to avoid false sharing between event loops.
 typedef struct {
+	as_event_loop* event_loop;  // Event loop that owns this shard.
+	loop_state state;
+	uint32_t begin;       // First key in this shard's key range.
 	uint32_t next_id;     // Key of next record to write.
-	uint32_t max;         // Number of records to write.
-	uint32_t count;       // Records written.
+	uint32_t max;         // Key after last record to write.
+	uint64_t count;       // Records written.
+	uint64_t errors;      // Write errors.
+	uint64_t reads;       // Records read, including not found. Mixed mode only.
+	uint64_t read_errors; // Read errors. Mixed mode only.
+	uint64_t seed;        // Random seed for key and operation choice. Mixed mode only.
+	uint32_t inflight;    // Commands issued but not completed.
+	uint32_t found;       // Records found by batch read.
+	uint32_t batch_next;  // Key of next record to batch read.
+	uint32_t batch_inflight;  // Batch chunks inflight.
+	uint32_t batch_chunks;    // Batch chunks completed.
+	struct batch_chunk_s* chunks;  // Reusable batch chunk pool.
 	uint32_t queue_size;  // Maximum records allowed inflight (in async queue).
+	window window;        // Adaptive queue_size controller. Adaptive mode only.
+	command_pool pool;    // Command contexts.
 	uint32_t pipe_count;  // Records in pipeline. Pipeline mode only.
 	as_pipe_listener pipe_listener;  // Pipeline listener callback. Pipeline mode only.
-} counter;
+	uint32_t ramp_target; // Commands primed into pipeline. Pipeline mode only.
+	uint32_t sent;        // Commands sent by pipeline. Pipeline mode only.
+	uint64_t ramp_begin;  // Pipeline priming start time. Pipeline mode only.
+	uint64_t ramp_time;   // Time until all primed commands were sent. Pipeline mode only.
+	uint64_t depth_sum;   // Sum of pipeline depth sampled at each completion after ramp-up.
+	uint64_t depth_samples;
+	loop_timer send_timer;  // Fires at next intended send time. Open-loop mode only.
+	uint64_t next_send;   // Intended send time of next scheduled command. Open-loop mode only.
+	uint64_t send_interval;  // Mean time between sends on this loop. Open-loop mode only.
+	uint64_t intended;    // Intended send time of command being issued. Open-loop mode only.
+	uint64_t backlog;     // Commands due but not yet sent. Open-loop mode only.
+	uint64_t lag_max;     // Furthest sends fell behind schedule. Open-loop mode only.
+	uint64_t missed;      // Commands due before the end but never sent. Open-loop mode only.
+	bool send_done;       // Schedule has ended. Open-loop mode only.
+	loop_timer refill_timer;  // Token bucket refill. Throttle mode only.
+	double tokens;        // Commands that may be issued now. Throttle mode only.
+	double tokens_max;    // Bucket size. Throttle mode only.
+	double token_rate;    // Tokens per nanosecond. Throttle mode only.
+	uint64_t refill_time; // Last refill. Throttle mode only.
+	uint64_t throttle_end;  // When this loop ran out of writes. Throttle mode only.
+	bool throttle_active; // Refill timer is running. Throttle mode only.
+	loop_timer stall_timer;  // Issues again after a failed issue left nothing in flight.
+	bool stall_active;    // Stall timer is initialized.
+	const char* load_pos; // Next record in this loop's input range. Loader mode only.
+	const char* load_end; // End of this loop's input range. Loader mode only.
+	uint64_t malformed;   // Input records skipped. Loader mode only.
+	as_scan scan;         // Paginated scan of this loop's partitions. Export mode only.
+	as_partition_filter partitions;  // Export mode only.
+	export_writer writer; // Export mode only.
+	uint64_t pages;       // Scan pages completed. Export mode only.
+	uint64_t stalls;      // Times the scan paused for the writer. Export mode only.
+	bool export_paused;   // Waiting for a buffer before the next page. Export mode only.
+	bool export_done;     // Scan has ended. Export mode only.
+	bool page_inflight;   // A scan page is being read. Export mode only.
+	retry_queue retry;    // Backoff and hedge timers, and batch chunks that failed to issue.
+	uint64_t retries;     // Commands and chunks sent again after a retryable error.
+	uint64_t exhausted;   // Retryable errors that ran out of retries.
+	uint64_t batch_errors;  // Batch chunks that failed. Retry mode only.
+	histogram hedge_sample;  // Read latency since the last hedge delay update. Hedge mode only.
+	uint64_t hedge_delay; // p95 read latency of the last window. Hedge mode only.
+	uint64_t hedges;      // Duplicate reads sent. Hedge mode only.
+	uint64_t hedge_wins;  // Reads answered by the duplicate first. Hedge mode only.
+	submit_queue submit;  // Commands from producer threads. Submit mode only.
+	void* notifier;       // Wakes the loop after a push into an empty ring. Submit mode only.
+	uint64_t submitted;   // Commands taken from the ring and issued. Submit mode only.
+	uint64_t wakeups;     // Notifier callbacks. Submit mode only.
+	bool producers_done;  // No more pushes will come. Submit mode only.
+	bool submit_finished; // Batch read has started. Submit mode only.
+	histogram submit_latency;  // Enqueue to issue latency. Submit mode only.
+	coro_arena coros;     // Worker frames. Coroutine mode only.
+	uint32_t workers;     // Workers not yet finished. Coroutine mode only.
+	uint64_t* node_commands;   // Commands sent to each node, then to unknown nodes.
+	uint64_t drain_begin; // Shutdown reached this loop.
+	uint64_t drain_time;  // Time from the last issue until the last completion.
+	uint32_t drain_inflight;  // Commands and batch chunks in flight at shutdown.
+	uint64_t issued;      // Commands handed to the client, including retries and hedges.
+	uint64_t write_bytes; // Bin value bytes of writes issued. Retries are not counted again.
+	uint64_t error_codes[STATS_CODES];  // Errors by status code, see stats_code_slot().
+	loop_stats stats;     // Loop thread cpu time, I/O wait and iterations.
+	histogram write_latency;  // Write completion latency.
+	histogram read_latency;   // Read completion latency. Mixed mode only.
+	histogram batch_latency;  // Batch read completion latency.
+} __attribute__((aligned(CACHE_LINE_SIZE))) counter;
+
+// Batch read of one key range chunk. Chunks and their records are pooled per
+// event loop and reused, so batch read memory is bounded by chunk size times
+// chunks inflight.
+typedef struct batch_chunk_s {
+	counter* counter;
+	as_batch_read_records* records;
+	uint64_t begin;       // Batch read issue time.
+	retry_entry timer;    // Retry backoff, or report of a failed issue.
+	uint32_t attempts;    // Retries so far. Retry mode only.
+	as_error error;       // Why the chunk failed to issue.
+} batch_chunk;
+
+// Periodic benchmark report. Runs on a timer on the first event loop.
+typedef struct {
+	loop_timer timer;
+	as_event_loop* event_loop;
+	uint64_t last_time;
+	uint64_t last_count;
+	uint64_t last_reads;
+	uint64_t last_errors;
+	loop_stats* last_stats;  // Per event loop stats at last report.
+	uint64_t* last_events;   // Per event loop events at last report.
+	bool active;
+} reporter;
+
+// Per-loop metric read straight from a uint64_t counter shard field.
+typedef struct {
+	const char* name;
+	const char* help;
+	size_t offset;
+} loop_metric;
+
+// Per-command state passed as listener udata. Key namespace/set and record
+// bin storage are initialized once when the pool is created.
+typedef struct command_s {
+	struct command_s* next;  // Next free command. Pooled commands only.
+	counter* counter;
+	uint64_t begin;       // Command issue time.
+	as_key key;
+	as_record record;
+	as_bin_value* values;  // Bin values wrapping the input mapping. Loader mode only.
+	retry_entry timer;    // Retry backoff, or hedge delay of a read.
+	uint32_t attempts;    // Retries so far.
+	uint32_t outstanding; // Copies of this read inflight. Reads only.
+	uint64_t latency;     // Latency of the first answer. Reads only.
+	bool read;
+	bool answered;        // A copy of this read has answered. Reads only.
+	bool error;           // The answer was an error. Reads only.
+} command;
+
+// Coroutine workload frame. Each one fills a window slot, issuing its next
+// command when the last completes. Frames live in the loop's coroutine arena.
+typedef struct {
+	coro co;
+	counter* counter;
+	command* cmd;         // Command in flight or backing off.
+} worker;
 
 /******************************************************************************
  *	Globals
@@ -48,25 +237,206 @@ static int g_port = 3000;
 static const char* g_namespace = "test";
 static const char* g_set = "test";
 
+static uint32_t g_max_records = 5000;
+static bool g_pipeline = false;
+
+// Streaming batch reads.
+static uint32_t g_batch_size = 1000;
+static uint32_t g_batch_inflight = 4;
+
+// Record layout.
+static uint32_t g_bin_count = 1;
+static char (*g_bin_names)[AS_BIN_NAME_MAX_SIZE];
+static value_spec g_value_spec = {.type = VALUE_INT};
+static value_arena g_values;
+
+// Mixed read/write workload.
+static bool g_mixed = false;
+static uint32_t g_read_percent = 0;
+static distribution_type g_key_type = DISTRIBUTION_UNIFORM;
+static double g_hot_set = 0.2;
+static double g_hot_ops = 0.8;
+static distribution g_keys;
+
+// Adaptive in-flight window. Latency target is in nanoseconds.
+static bool g_adaptive = false;
+static uint64_t g_latency_target = 0;
+
+// Open-loop mode. Commands are sent on a schedule at g_rate ops/sec across
+// all loops, whether or not earlier commands have completed.
+static double g_rate = 0;
+static bool g_poisson = false;
+
+// Loader mode. Records come from a memory-mapped input file.
+static const char* g_load_path = NULL;
+static loader_file g_load;
+static const char** g_load_bounds = NULL;  // Input range of each loop, g_loop_count + 1 entries.
+
+// Export mode. Records are scanned into a file.
+static const char* g_export_path = NULL;
+static export_file g_export;
+
+// Retry mode. Retryable errors are sent again up to g_max_retries times after
+// a jittered exponential backoff, and no error stops the run.
+static uint32_t g_max_retries = 0;
+
+// Hedged reads. A read that has not answered within the loop's recent p95
+// read latency is sent again, and the first answer wins.
+static bool g_hedge = false;
+
+// Throttle mode. Each loop issues at most its share of g_throttle ops/sec.
+static double g_throttle = 0;
+
+// Connection warm-up. Async connections opened per node per event loop
+// before the workload starts.
+static uint32_t g_warm_conns = 0;
+static warm_up* g_warm_ups;
+static int64_t* g_warm_keys;  // g_warm_conns keys mastered by each node, shared by all loops.
+static uint32_t g_warm_key_count;
+static uint32_t g_warm_remaining;
+static as_monitor warm_up_monitor;
+
+// Routing mode. Keys are grouped by the loop their partition's master node
+// is routed to, and shard key ranges index into the grouped keys.
+static bool g_route = false;
+static route_table g_routes;
+
+// Submit mode. Application threads generate the workload and hand commands
+// to the owning event loop through a lock-free ring.
+static uint32_t g_submit_threads = 0;
+static uint32_t g_submit_remaining;
+static uint32_t g_producers_remaining;
+static pthread_t* g_producers;
+static uint64_t g_submit_full;  // Pushes that found the ring full.
+static as_monitor submit_ready_monitor;
+
+// Coroutine mode. The async workload runs as one worker coroutine per window
+// slot instead of chained listener callbacks.
+static bool g_coro = false;
+
+// Stats endpoint. Prometheus text on a Unix socket, rendered from the
+// counter shards on the server's own thread.
+static const char* g_stats_path = NULL;
+static stats_server g_stats;
+
+static const loop_metric g_loop_metrics[] = {
+	{"async_tutorial_issued_total", "Commands handed to the client, including retries and hedges.",
+		offsetof(counter, issued)},
+	{"async_tutorial_retries_total", "Commands and batch chunks sent again after a retryable error.",
+		offsetof(counter, retries)},
+	{"async_tutorial_retries_exhausted_total", "Retryable errors that ran out of retries.",
+		offsetof(counter, exhausted)},
+	{"async_tutorial_hedges_total", "Duplicate reads sent.", offsetof(counter, hedges)},
+	{"async_tutorial_write_bytes_total", "Bin value bytes of writes issued.", offsetof(counter, write_bytes)}
+};
+
+// Benchmark mode. Times are in nanoseconds.
+static bool g_benchmark = false;
+static uint64_t g_duration = 0;
+static uint64_t g_warmup = 0;
+static uint64_t g_interval = 1000000000;
+static uint64_t g_warmup_end = 0;
+static uint64_t g_end = 0;
+static reporter g_reporter;
+
 static aerospike as;
 static as_monitor share_loops_monitor;
-static as_monitor app_complete_monitor;
+
+// Shutdown. Set once by the first error or interrupt that stops the run.
+// Main waits in sigwait() for interrupts and for the last loop to close.
+static uint32_t g_shutdown = 0;
+static const char* g_shutdown_reason;
+static uint64_t g_shutdown_time;
+static pthread_t g_main_thread;
+static sigset_t g_signals;
+
+static loop** g_loops;
+static counter** g_counters;
+static uint32_t g_loop_count = 1;
+static uint32_t g_loops_remaining;
+static affinity g_affinity;
 
 /******************************************************************************
  *	Forward Declarations
  *****************************************************************************/
 
 static void print_usage(const char* program);
-static bool share_event_loops(loop* loops, uint32_t loop_count);
-static void join_event_loops(loop* loops, uint32_t loop_count);
+static bool share_event_loops(uint32_t loop_count);
+static void join_event_loops(uint32_t loop_count);
+static void warm_up_connections(void);
+static void start_producers(void);
+static void wait_complete(void);
+static bool shutdown_begin(const char* reason);
+static void drain_loop(void* udata);
+static void drain_check(counter* counter);
+static void notify_complete(void);
+static void* submit_thread(void* udata);
 static void* loop_thread(void* udata);
+static void start_writes(void* udata);
 static void write_records_pipeline(counter* counter);
+static void fill_pipeline(counter* counter);
 static void write_records_async(counter* counter);
-static bool write_record(as_event_loop* event_loop, counter* counter);
+static void fill_window(as_event_loop* event_loop, counter* counter, uint64_t now);
+static void issue_failed(counter* counter);
+static void stall_fired(void* udata);
+static bool issue_command(as_event_loop* event_loop, counter* counter);
+static bool next_key(counter* counter, int64_t* id);
+static inline uint32_t shard_offset(uint64_t sample, uint32_t range);
+static void command_pool_init(command_pool* pool, counter* counter, uint32_t capacity);
+static void command_pool_destroy(command_pool* pool);
+static command* command_acquire(counter* counter, int64_t id);
+static void command_release(command* cmd);
+static bool write_record(as_event_loop* event_loop, counter* counter, int64_t id);
+static void set_bins(command* cmd, int64_t id);
+static bool read_record(as_event_loop* event_loop, counter* counter, int64_t id);
+static void write_error(counter* counter, as_error* err);
+static bool read_error(counter* counter, as_error* err);
+static bool has_more_writes(counter* counter, uint64_t now);
+static bool load_record(as_event_loop* event_loop, counter* counter);
+static bool put_command(as_event_loop* event_loop, counter* counter, command* cmd);
+static void load_check_done(counter* counter);
+static bool schedule_retry(counter* counter, retry_entry* entry, uint32_t* attempts, as_status code,
+	retry_callback callback, void* udata);
+static void resend_command(void* udata);
+static void resend_chunk(void* udata);
+static void chunk_failed(batch_chunk* chunk, as_error* err);
+static void report_chunk(void* udata);
+static void send_hedge(void* udata);
 static void pipeline_listener(void* udata, as_event_loop* event_loop);
 static void write_listener(as_error* err, void* udata, as_event_loop* event_loop);
-static void batch_read(as_event_loop* event_loop, uint32_t max_records);
+static void read_listener(as_error* err, as_record* record, void* udata, as_event_loop* event_loop);
+static void hedge_listener(as_error* err, as_record* record, void* udata, as_event_loop* event_loop);
+static void read_response(as_event_loop* event_loop, command* cmd, as_error* err, bool hedge);
+static void command_complete(as_event_loop* event_loop, counter* counter, uint64_t latency, bool error, uint64_t now);
+static void batch_read(as_event_loop* event_loop, counter* counter);
+static void batch_read_chunk(as_event_loop* event_loop, batch_chunk* chunk);
 static void batch_listener(as_error* err, as_batch_read_records* records, void* udata, as_event_loop* event_loop);
+static void batch_next_chunk(as_event_loop* event_loop, batch_chunk* chunk);
+static void loop_complete(counter* counter);
+static uint64_t counter_events(counter* counter);
+static void start_open_loop(counter* counter);
+static void start_throttle(counter* counter);
+static void stop_throttle(counter* counter);
+static bool take_token(counter* counter);
+static void resume_writes(counter* counter, uint64_t now);
+static void send_due(as_event_loop* event_loop, counter* counter, uint64_t now);
+static void start_submit(counter* counter);
+static void submit_drain(counter* counter);
+static void submit_close(void* udata);
+static void start_workers(counter* counter);
+static void worker_run(coro* co);
+static void worker_issue(worker* w);
+static void worker_finish(worker* w);
+static void start_export(counter* counter);
+static void export_page(counter* counter);
+static bool export_listener(as_error* err, as_record* record, void* udata, as_event_loop* event_loop);
+static void export_resume(counter* counter);
+static void export_drain(counter* counter);
+static void export_complete(void);
+static void start_reporter(as_event_loop* event_loop);
+static void stop_reporter(as_event_loop* event_loop);
+static void report(void* udata);
+static void write_stats(FILE* out, void* udata);
 
 /******************************************************************************
  *	Functions
@@ -86,13 +456,11 @@ log_callback(as_log_level level, const char * func, const char * file, uint32_t
 int
 main(int argc, char* argv[])
 {
-	loop external_loop;
-	uint32_t max_records = 5000;
 	bool share_loop = false;
-	bool pipeline = false;
+	bool key_distribution = false;
 	int c;
 	
-	while ((c = getopt(argc, argv, "h:p:n:s:el")) != -1) {
+	while ((c = getopt(argc, argv, "h:p:n:s:L:A:S:C:k:b:v:f:x:B:K:m:D:a:r:R:T:d:w:i:M:HNPcel")) != -1) {
 		switch (c) {
 			case 'h':
 				g_host = optarg;
@@ -106,37 +474,366 @@ main(int argc, char* argv[])
 			case 's':
 				g_set = optarg;
 				break;
+			case 'L':
+				g_loop_count = atoi(optarg);
+				if (g_loop_count == 0) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'A':
+				if (! affinity_parse(&g_affinity, optarg)) {
+					printf("Invalid cpu affinity: %s\n", optarg);
+					return -1;
+				}
+				// Only shared event loop threads can be pinned.
+				share_loop = true;
+				break;
 			case 'e':
 				share_loop = true;
 				break;
+			case 'N':
+				g_route = true;
+				break;
+			case 'S':
+				g_submit_threads = (uint32_t)strtoul(optarg, NULL, 10);
+				if (g_submit_threads == 0) {
+					printf("Invalid producer thread count: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'C':
+				g_warm_conns = (uint32_t)strtoul(optarg, NULL, 10);
+				if (g_warm_conns == 0 || g_warm_conns > MAX_CONNS_PER_LOOP) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'k':
+				g_max_records = (uint32_t)strtoul(optarg, NULL, 10);
+				if (g_max_records == 0) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'b':
+				g_bin_count = (uint32_t)strtoul(optarg, NULL, 10);
+				if (g_bin_count == 0 || g_bin_count > MAX_BINS) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'v':
+				if (! value_spec_parse(&g_value_spec, optarg)) {
+					printf("Invalid value spec: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'B':
+				g_batch_size = (uint32_t)strtoul(optarg, NULL, 10);
+				if (g_batch_size == 0) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'K':
+				g_batch_inflight = (uint32_t)strtoul(optarg, NULL, 10);
+				if (g_batch_inflight == 0) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'm':
+				g_mixed = true;
+				g_read_percent = (uint32_t)strtoul(optarg, NULL, 10);
+				if (g_read_percent > 100) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'D': {
+				char* hot = strchr(optarg, ':');
+
+				if (hot) {
+					*hot++ = 0;
+				}
+
+				if (! distribution_parse_type(optarg, &g_key_type) || g_key_type == DISTRIBUTION_FIXED) {
+					printf("Invalid key distribution: %s\n", optarg);
+					return -1;
+				}
+
+				if (hot && g_key_type == DISTRIBUTION_HOTSPOT) {
+					// hotspot:<hot set %>:<hot ops %>
+					g_hot_set = strtod(hot, &hot) / 100.0;
+					g_hot_ops = (*hot == ':') ? strtod(hot + 1, NULL) / 100.0 : g_hot_ops;
+
+					if (g_hot_set <= 0 || g_hot_set > 1 || g_hot_ops <= 0 || g_hot_ops > 1) {
+						printf("Hotspot percentages must be above 0 and at most 100\n");
+						return -1;
+					}
+				}
+				key_distribution = true;
+				break;
+			}
+			case 'a':
+				g_adaptive = true;
+				g_latency_target = strtoull(optarg, NULL, 10) * 1000;
+				if (g_latency_target == 0) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'f':
+				g_load_path = optarg;
+				break;
+			case 'x':
+				g_export_path = optarg;
+				break;
+			case 'r':
+				g_throttle = strtod(optarg, NULL);
+				if (g_throttle <= 0) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'R':
+				g_rate = strtod(optarg, NULL);
+				if (g_rate <= 0) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'P':
+				g_poisson = true;
+				break;
+			case 'T':
+				g_max_retries = (uint32_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'H':
+				g_hedge = true;
+				break;
+			case 'd':
+				g_benchmark = true;
+				g_duration = strtoull(optarg, NULL, 10) * 1000000000;
+				break;
+			case 'w':
+				g_warmup = strtoull(optarg, NULL, 10) * 1000000000;
+				break;
+			case 'i':
+				g_interval = strtoull(optarg, NULL, 10) * 1000000000;
+				if (g_interval == 0) {
+					print_usage(argv[0]);
+					return -1;
+				}
+				break;
 			case 'l':
-				pipeline = true;
+				g_pipeline = true;
+				break;
+			case 'M':
+				g_stats_path = optarg;
+				break;
+			case 'c':
+				g_coro = true;
 				break;
 			default:
 				print_usage(argv[0]);
 				return 0;
 		}
 	}
+
+	if (g_rate > 0 && ! g_benchmark) {
+		printf("Open-loop mode (-R) requires benchmark mode (-d)\n");
+		return -1;
+	}
+
+	if (g_load_path && (g_benchmark || g_mixed)) {
+		printf("Loader mode (-f) can not be combined with -d or -m\n");
+		return -1;
+	}
+
+	if (g_export_path && (g_benchmark || g_mixed || g_load_path || g_rate > 0 || g_throttle > 0)) {
+		printf("Export mode (-x) can not be combined with -d, -m, -f, -r or -R\n");
+		return -1;
+	}
+
+	if (g_warm_conns > 0 && g_pipeline) {
+		printf("Connection warm-up (-C) opens async connections, which pipeline mode (-l) does not use\n");
+		return -1;
+	}
+
+	if (key_distribution && ! g_mixed) {
+		printf("Key distribution (-D) requires a mixed workload (-m)\n");
+		return -1;
+	}
+
+	if (g_hedge && ! g_mixed) {
+		printf("Hedged reads (-H) require a mixed workload (-m)\n");
+		return -1;
+	}
+
+	if (g_rate > 0 && g_throttle > 0) {
+		printf("Throttle (-r) and open-loop (-R) modes are exclusive\n");
+		return -1;
+	}
+
+	if (g_route && (g_load_path || g_export_path || g_submit_threads > 0)) {
+		printf("Routing mode (-N) can not be combined with -f, -x or -S\n");
+		return -1;
+	}
+
+	if (g_submit_threads > 0 && (g_pipeline || g_load_path || g_export_path || g_rate > 0 || g_throttle > 0)) {
+		printf("Submit mode (-S) can not be combined with -l, -f, -x, -r or -R\n");
+		return -1;
+	}
+
+	if (g_coro && (g_pipeline || g_load_path || g_export_path || g_rate > 0 || g_throttle > 0 ||
+		g_submit_threads > 0 || g_adaptive || g_hedge)) {
+		printf("Coroutine mode (-c) can not be combined with -l, -f, -x, -r, -R, -S, -a or -H\n");
+		return -1;
+	}
 	
 	printf("Host=%s:%d\n", g_host, g_port);
 	printf("Namespace=%s\n", g_namespace);
 	printf("Set=%s\n", g_set);
+	printf("Loops=%u\n", g_loop_count);
 	printf("ShareLoop=%s\n", share_loop ? "true" : "false");
-	printf("Pipeline=%s\n", pipeline ? "true" : "false");
+	printf("Pipeline=%s\n", g_pipeline ? "true" : "false");
+
+	if (g_route) {
+		printf("Route=partition master node\n");
+	}
+
+	if (g_submit_threads > 0) {
+		printf("Submit=%u producer threads, %u command ring per loop\n", g_submit_threads, SUBMIT_RING_SIZE);
+	}
+
+	if (g_coro) {
+		printf("Coroutines=%u workers per loop\n", ASYNC_QUEUE_SIZE);
+	}
+
+	if (g_warm_conns > 0) {
+		printf("WarmUp=%u connections per node per loop\n", g_warm_conns);
+	}
+
+	char value_str[64];
+	value_spec_print(&g_value_spec, value_str, sizeof(value_str));
+	if (g_load_path) {
+		if (! loader_open(&g_load, g_load_path)) {
+			printf("Failed to map input file %s\n", g_load_path);
+			return -1;
+		}
+		printf("Load=%s (%s, %.1f MB)\n", g_load_path, g_load.format == LOADER_BINARY ? "binary" : "text",
+			g_load.size / 1000000.0);
+
+		// Binary records are only found by walking the file, so split it in
+		// one walk here rather than once per loop.
+		g_load_bounds = malloc(sizeof(const char*) * (g_loop_count + 1));
+		loader_split(&g_load, g_loop_count, g_load_bounds);
+		printf("Bins=%u max per record\n", g_bin_count);
+	}
+	else if (g_export_path) {
+		if (! export_file_open(&g_export, g_export_path, export_format_from_path(g_export_path))) {
+			printf("Failed to create export file %s\n", g_export_path);
+			return -1;
+		}
+		printf("Export=%s (%s)\n", g_export_path, g_export.format == EXPORT_CSV ? "csv" : "binary");
+	}
+	else {
+		printf("Records=%u\n", g_max_records);
+		printf("Bins=%u\n", g_bin_count);
+		printf("Value=%s\n", value_str);
+	}
+	printf("BatchChunk=%u keys, %u inflight per loop\n", g_batch_size, g_batch_inflight);
+
+	if (g_mixed) {
+		printf("Mixed=%u%% reads, %u%% writes\n", g_read_percent, 100 - g_read_percent);
+
+		if (g_key_type == DISTRIBUTION_HOTSPOT) {
+			printf("KeyDistribution=hotspot (%.0f%% of ops on %.0f%% of keys)\n", g_hot_ops * 100, g_hot_set * 100);
+		}
+		else {
+			printf("KeyDistribution=%s\n", distribution_type_name(g_key_type));
+		}
+	}
+
+	if (g_adaptive) {
+		printf("LatencyTarget=%lluus\n", (unsigned long long)(g_latency_target / 1000));
+	}
+
+	if (g_rate > 0) {
+		printf("OpenLoop=%.0f ops/sec, %s arrivals\n", g_rate, g_poisson ? "poisson" : "constant");
+	}
+
+	if (g_throttle > 0) {
+		printf("Throttle=%.0f ops/sec\n", g_throttle);
+	}
+
+	if (g_max_retries > 0) {
+		printf("Retries=%u, backoff %u-%ums\n", g_max_retries, RETRY_BASE_US / 1000, RETRY_MAX_US / 1000);
+	}
+
+	if (g_hedge) {
+		printf("HedgedReads=p95\n");
+	}
+
+	if (g_benchmark) {
+		printf("Duration=%llus\n", (unsigned long long)(g_duration / 1000000000));
+		printf("Warmup=%llus\n", (unsigned long long)(g_warmup / 1000000000));
+		printf("Interval=%llus\n", (unsigned long long)(g_interval / 1000000000));
+	}
 	
 	as_log_set_level(AS_LOG_LEVEL_INFO);
 	as_log_set_callback(log_callback);
 
+	// Generate bin names and values up front, so building records does
+	// not dominate the measured path.
+	g_bin_names = malloc(sizeof(*g_bin_names) * g_bin_count);
+
+	for (uint32_t i = 0; i < g_bin_count; i++) {
+		if (g_bin_count == 1) {
+			strcpy(g_bin_names[i], "test-bin");
+		}
+		else {
+			snprintf(g_bin_names[i], sizeof(g_bin_names[i]), "test-bin-%u", i);
+		}
+	}
+
+	if (! value_arena_init(&g_values, &g_value_spec, VALUE_COUNT)) {
+		printf("Failed to generate values\n");
+		return -1;
+	}
+	printf("RecordSize=%llu bytes (average)\n",
+		(unsigned long long)(value_arena_avg_size(&g_values) * g_bin_count));
+
+	if (g_mixed) {
+		// Keys are drawn as offsets into the longest loop key range, then
+		// scaled to each loop's own range by shard_offset().
+		uint32_t range = (g_max_records + g_loop_count - 1) / g_loop_count;
+		distribution_init(&g_keys, g_key_type, 0, range ? range - 1 : 0);
+		distribution_set_hotspot(&g_keys, g_hot_set, g_hot_ops);
+	}
+
+	// Block interrupts and the completion signal before any thread is
+	// created. Every thread inherits the mask, so only main's sigwait()
+	// receives them.
+	g_main_thread = pthread_self();
+	sigemptyset(&g_signals);
+	sigaddset(&g_signals, SIGINT);
+	sigaddset(&g_signals, SIGTERM);
+	sigaddset(&g_signals, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &g_signals, NULL);
+
 	if (share_loop) {
-		// Demonstrate how to share an existing event loop.
-		if (! share_event_loops(&external_loop, 1)) {
+		// Demonstrate how to share existing event loops.
+		if (! share_event_loops(g_loop_count)) {
 			printf("Failed to share event loop\n");
 			return -1;
 		}
 	}
 	else {
-		// Have C client create the event loop.
-		if (! as_event_create_loops(1)) {
+		// Have C client create the event loops.
+		if (! as_event_create_loops(g_loop_count)) {
 			printf("Failed to create event loop\n");
 			return -1;
 		}
@@ -145,8 +842,14 @@ main(int argc, char* argv[])
 	as_config cfg;
 	as_config_init(&cfg);
 	as_config_add_host(&cfg, g_host, g_port);
-	cfg.async_max_conns_per_node = 200;
+	cfg.async_max_conns_per_node = MAX_CONNS_PER_LOOP * g_loop_count;  // Divided evenly among event loops.
 	cfg.thread_pool_size = 0;  // disable sync thread pools.
+
+	if (g_affinity.size > 0) {
+		// Keep tend thread off event loop cores.
+		cfg.tend_thread_cpu = affinity_free_cpu(&g_affinity, g_loop_count);
+		printf("TendThreadCpu=%d\n", cfg.tend_thread_cpu);
+	}
 	aerospike_init(&as, &cfg);
 	
 	// Connect to cluster.
@@ -158,63 +861,186 @@ main(int argc, char* argv[])
 		return -1;
 	}
 	
-	// Initialize monitor.
-	as_monitor_init(&app_complete_monitor);
-	
-	if (pipeline) {
-		// Demonstrate pipelined writes.
-		// Pipeline queue size (1000) is greater because sockets are shared.
-		counter counter = {
-			.next_id = 0,
-			.max = max_records,
-			.count = 0,
-			.queue_size = 1000,
-			.pipe_count = 0,
-			.pipe_listener = pipeline_listener
-		};
-		write_records_pipeline(&counter);
+	if (! g_export_path) {
+		// Snapshot partition ownership for routing and the node distribution report.
+		if (! route_table_init(&g_routes, &as, g_namespace, PARTITION_COUNT, g_loop_count)) {
+			printf("Namespace %s not found\n", g_namespace);
+			aerospike_close(&as, &err);
+			aerospike_destroy(&as);
+			as_event_close_loops();
+			return -1;
+		}
+
+		if (g_route) {
+			route_keys_group(&g_routes, g_namespace, g_set, g_max_records);
+		}
 	}
-	else {
-		// Demonstrate async non-pipelined writes.
-		// Async queue size (100) is less because there is one socket per concurrent command.
-		counter counter = {
-			.next_id = 0,
-			.max = max_records,
-			.count = 0,
-			.queue_size = 100,
-			.pipe_count = 0,
-			.pipe_listener = NULL
-		};
-		write_records_async(&counter);
+
+	if (g_warm_conns > 0) {
+		// Open connections before any timing starts.
+		warm_up_connections();
+	}
+
+	// Each event loop allocates its own counter shard in start_writes().
+	g_counters = calloc(g_loop_count, sizeof(counter*));
+	g_loops_remaining = g_loop_count;
+
+	if (g_stats_path) {
+		// Scrapes read shards as soon as their loops allocate them.
+		if (! stats_server_start(&g_stats, g_stats_path, write_stats, NULL)) {
+			printf("Failed to open stats socket %s\n", g_stats_path);
+			aerospike_close(&as, &err);
+			aerospike_destroy(&as);
+			as_event_close_loops();
+			return -1;
+		}
+		printf("Stats=%s\n", g_stats_path);
+	}
+
+	if (g_submit_threads > 0) {
+		// Producers start once every loop has its ring.
+		g_submit_remaining = g_loop_count;
+		as_monitor_init(&submit_ready_monitor);
+	}
+
+	if (g_benchmark) {
+		uint64_t now = histogram_now();
+		g_warmup_end = now + g_warmup;
+		g_end = g_warmup_end + g_duration;
+	}
+
+	// Start writes from each event loop's own thread, so counter shards
+	// are never touched by more than one thread.
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		as_event_loop* event_loop = as_event_loop_get_by_index(i);
+		as_event_execute(event_loop, start_writes, event_loop);
+	}
+
+	if (g_submit_threads > 0) {
+		start_producers();
 	}
 	
-	// Wait till all commands have completed before shutting down.
-	as_monitor_wait(&app_complete_monitor);
-	as_monitor_destroy(&app_complete_monitor);
+	// Wait till every loop has drained and closed before shutting down.
+	wait_complete();
+
+	if (g_submit_threads > 0) {
+		// Producers have stopped pushing. The last one to exit posts submit_close().
+		for (uint32_t i = 0; i < g_submit_threads; i++) {
+			pthread_join(g_producers[i], NULL);
+		}
+		free(g_producers);
+	}
+
+	// Loops have nothing in flight, so closing the client loses no commands.
+	// It is closed from main, because as_event_close_loops() joins the loop
+	// threads it created.
 	aerospike_close(&as, &err);
 	aerospike_destroy(&as);
 	as_event_close_loops();
 	
 	if (share_loop) {
-		// Join on external event loop thread.
-#if defined(AS_USE_LIBEVENT)
-		event_base_loopbreak(external_loop.event_loop);
-#endif
-		join_event_loops(&external_loop, 1);
+		// Join on external event loop threads.
+		if (g_backend.stop) {
+			for (uint32_t i = 0; i < g_loop_count; i++) {
+				g_backend.stop(g_loops[i]->native);
+			}
+		}
+		join_event_loops(g_loop_count);
 	}
 	as_event_destroy_loops();
+
+	if (g_stats_path) {
+		// No scrape may read a shard once it is freed.
+		stats_server_stop(&g_stats);
+	}
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		counter* counter = g_counters[i];
+
+		if (counter->chunks) {
+			for (uint32_t j = 0; j < g_batch_inflight; j++) {
+				as_batch_read_destroy(counter->chunks[j].records);
+			}
+			affinity_free_local(counter->chunks);
+		}
+		if (g_export_path) {
+			if (counter->writer.file) {
+				export_writer_close(&counter->writer);
+			}
+			as_scan_destroy(&counter->scan);
+		}
+		if (g_submit_threads > 0) {
+			submit_queue_destroy(&counter->submit);
+		}
+		if (counter->node_commands) {
+			affinity_free_local(counter->node_commands);
+		}
+		coro_arena_destroy(&counter->coros);
+		command_pool_destroy(&counter->pool);
+		affinity_free_local(counter);
+	}
+	free(g_counters);
+	value_arena_destroy(&g_values);
+
+	if (g_load_path) {
+		free(g_load_bounds);
+		loader_close(&g_load);
+	}
+
+	if (g_export_path) {
+		export_file_close(&g_export);
+	}
+	else {
+		route_table_destroy(&g_routes);
+	}
+	free(g_bin_names);
 }
 
 static void
 print_usage(const char* program)
 {
-	printf("Usage: %s [-h <host>] [-p <port>] [-n <namespace>] [-s <set>] [-e] [-l]\n", program);
-	printf("-e: share event loop\n");
+	printf("Usage: %s [-h <host>] [-p <port>] [-n <namespace>] [-s <set>] [-L <loops>] [-A <cpus>] [-e] [-l] [-c] [-C <conns>]\n"
+		"       [-N] [-S <threads>] [-k <records>] [-b <bins>] [-v <value>] [-f <file>] [-x <file>] [-B <keys>] [-K <chunks>]\n"
+		"       [-m <read%%>] [-D <distribution>] [-a <latency>] [-r <ops/sec>] [-R <ops/sec>] [-P] [-T <retries>] [-H]\n"
+		"       [-d <seconds>] [-w <seconds>] [-i <seconds>] [-M <socket>]\n", program);
+	printf("-L: number of event loops (default 1)\n");
+	printf("-A: pin shared event loops to cpus, e.g. 2,4,6-9 or numa=auto (implies -e)\n");
+	printf("-e: share event loops\n");
 	printf("-l: use pipeline writes\n");
+	printf("-c: run the async workload as one coroutine per window slot instead of listener callbacks\n");
+	printf("-C: open <conns> async connections per node per loop before the workload, and report\n");
+	printf("    connect latency separately (max %u)\n", MAX_CONNS_PER_LOOP);
+	printf("-N: route each key to the loop that owns its partition's master node, instead of\n");
+	printf("    splitting the key range evenly between loops\n");
+	printf("-S: generate commands on <threads> producer threads that hand them to the owning\n");
+	printf("    event loop through a lock-free ring, and report enqueue-to-issue latency\n");
+	printf("-k: number of records (default 5000)\n");
+	printf("-b: number of bins per record (default 1)\n");
+	printf("-v: bin value <type>[:<size>[-<max>][:fixed|uniform|zipf]], type is int, string, bytes,\n");
+	printf("    list or map. Size is bytes for string/bytes, elements for list/map (default int)\n");
+	printf("-f: load records from <file> instead of generating them. -b is the maximum bins per record\n");
+	printf("-x: export the set to <file> with a partition-parallel scan, as csv if <file> ends in\n");
+	printf("    .csv, otherwise in the -f binary format\n");
+	printf("-B: keys per batch read chunk (default 1000)\n");
+	printf("-K: batch read chunks inflight per loop (default 4)\n");
+	printf("-m: mixed workload with <percent> reads, interleaved with writes\n");
+	printf("-D: mixed workload key distribution: uniform, zipf or hotspot[:<keys %%>:<ops %%>]\n");
+	printf("-a: adapt in-flight window to keep average latency under <microseconds>\n");
+	printf("-r: throttle writes to <ops/sec> across all loops, deferring writes over the rate\n");
+	printf("-R: open loop: send <ops/sec> across all loops on a schedule, measuring latency\n");
+	printf("    from each command's intended send time (requires -d)\n");
+	printf("-P: open loop sends follow a Poisson process instead of a constant rate\n");
+	printf("-T: retry timeouts, overload and connection errors up to <retries> times with jittered\n");
+	printf("    exponential backoff. Errors are counted instead of stopping the run\n");
+	printf("-H: hedged reads: send a second read if the first has not answered within p95 latency\n");
+	printf("-d: benchmark mode: keep writing for <seconds> after warmup\n");
+	printf("-w: benchmark warmup <seconds> excluded from results (default 0)\n");
+	printf("-i: benchmark reporting interval <seconds> (default 1)\n");
+	printf("-M: serve per-loop stats in Prometheus text format on Unix socket <socket>\n");
 }
 
 static bool
-share_event_loops(loop* loops, uint32_t loop_count)
+share_event_loops(uint32_t loop_count)
 {
 	// Tell C client the maximum number of event loops that will be shared.
 	if (! as_event_set_external_loop_capacity(loop_count)) {
@@ -224,15 +1050,18 @@ share_event_loops(loop* loops, uint32_t loop_count)
 	// Initialize monitor.
 	as_monitor_init(&share_loops_monitor);
 	bool status = true;
+
+	// Each event loop thread allocates its own loop struct.
+	g_loops = calloc(loop_count, sizeof(loop*));
 	
 	for (uint32_t i = 0; i < loop_count; i++) {
-		loop* loop = &loops[i];
-		
+		pthread_t thread;
+
 		// Start monitor.
 		as_monitor_begin(&share_loops_monitor);
 		
 		// Create event loop thread that will be shared.
-		if (pthread_create(&loop->thread, NULL, loop_thread, loop) != 0) {
+		if (pthread_create(&thread, NULL, loop_thread, (void*)(uintptr_t)i) != 0) {
 			status = false;
 			break;
 		}
@@ -245,226 +1074,2496 @@ share_event_loops(loop* loops, uint32_t loop_count)
 }
 
 static void
-join_event_loops(loop* loops, uint32_t loop_count)
+join_event_loops(uint32_t loop_count)
 {
 	for (uint32_t i = 0; i < loop_count; i++) {
-		loop* loop = &loops[i];
-		pthread_join(loop->thread, NULL);
+		pthread_join(g_loops[i]->thread, NULL);
+		affinity_free_local(g_loops[i]);
 	}
+	free(g_loops);
 }
 
 static void*
 loop_thread(void* udata)
 {
-	// Create external loop.
-	loop* loop = udata;
-
-#if defined(AS_USE_LIBUV)
-
-	loop->uv_loop = malloc(sizeof(uv_loop_t));
-	uv_loop_init(loop->uv_loop);
-
-	// Share event loop with C client.
-	// This must be done in event loop thread.
-	loop->as_loop = as_event_set_external_loop(loop->uv_loop);
-
-	// Notify parent thread that external loop has been initialized.
-	as_monitor_notify(&share_loops_monitor);
-
-	uv_run(loop->uv_loop, UV_RUN_DEFAULT);
-	uv_loop_close(loop->uv_loop);
-	free(loop->uv_loop);
-
-#elif defined(AS_USE_LIBEVENT)
-
-	loop->event_loop = event_base_new();
-
-	// Add a virtual event to prevent event_base_dispatch() from returning prematurely.
-#if LIBEVENT_VERSION_NUMBER < 0x02010000
-	event_base_add_virtual(loop->event_loop);
-#endif
-
-	// Share event loop with C client.
-	// This must be done in event loop thread.
-	loop->as_loop = as_event_set_external_loop(loop->event_loop);
-
-	// Notify parent thread that external loop has been initialized.
-	as_monitor_notify(&share_loops_monitor);
+	uint32_t index = (uint32_t)(uintptr_t)udata;
 
-#if LIBEVENT_VERSION_NUMBER < 0x02010000
-	event_base_dispatch(loop->event_loop);
-#else
-	event_base_loop(loop->event_loop, EVLOOP_NO_EXIT_ON_EMPTY);
-#endif
+	if (g_affinity.size > 0) {
+		// Pin thread before allocating loop state, so that state is placed
+		// on this cpu's NUMA node.
+		int cpu = affinity_cpu(&g_affinity, index);
 
-	event_base_free(loop->event_loop);
+		if (affinity_pin_thread(cpu)) {
+			printf("Loop %u pinned to cpu %d (node %d)\n", index, cpu, affinity_cpu_node(cpu));
+		}
+		else {
+			printf("Failed to pin loop %u to cpu %d\n", index, cpu);
+		}
+	}
 
-#else
+	// Create external loop.
+	loop* loop = affinity_alloc_local(sizeof(*loop));
+	loop->thread = pthread_self();
+	g_loops[index] = loop;
 
-	loop->ev_loop = ev_loop_new(EVFLAG_AUTO);
+	loop->native = g_backend.create(false);
 
 	// Share event loop with C client.
 	// This must be done in event loop thread.
-	loop->as_loop = as_event_set_external_loop(loop->ev_loop);
+	loop->as_loop = as_event_set_external_loop(loop->native);
 
 	// Notify parent thread that external loop has been initialized.
 	as_monitor_notify(&share_loops_monitor);
 
-	ev_loop(loop->ev_loop, 0);
-	ev_loop_destroy(loop->ev_loop);
-
-#endif
+	g_backend.run(loop->native);
+	g_backend.destroy(loop->native);
 	return NULL;
 }
 
 static void
-write_records_pipeline(counter* counter)
+warm_up_done(void* udata)
 {
-	// Write a single record to start pipeline.
-	// More records will be written in pipeline_listener to fill pipeline queue.
-	// A NULL event_loop indicates that an event loop will be chosen round-robin.
-	counter->pipe_count++;
-	write_record(NULL, counter);
+	if (as_aaf_uint32(&g_warm_remaining, -1) == 0) {
+		as_monitor_notify(&warm_up_monitor);
+	}
 }
 
 static void
-write_records_async(counter* counter)
+start_warm_up(void* udata)
 {
-	// Use same event loop for all records.
-	as_event_loop* event_loop = as_event_loop_get();
-	
-	// Write queue_size commands on the async queue.
-	for (uint32_t i = 0; i < counter->queue_size; i++) {
-		if (! write_record(event_loop, counter)) {
-			break;
-		}
-	}
-}
+	warm_up* w = udata;
+	as_event_loop* event_loop = as_event_loop_get_by_index((uint32_t)(w - g_warm_ups));
 
-static bool
-write_record(as_event_loop* event_loop, counter* counter)
-{
-	int64_t id = counter->next_id++;
-	
-	// No need to destroy a stack as_key object, if we only use as_key_init_int64().
-	as_key key;
-	as_key_init_int64(&key, g_namespace, g_set, id);
-	
-	// Create an as_record object with one (integer value) bin. By using
-	// as_record_inita(), we won't need to destroy the record if we only set
-	// bins using as_record_set_int64().
-	as_record rec;
-	as_record_inita(&rec, 1);
-	
-	// In general it's ok to reset a bin value - all as_record_set_... calls
-	// destroy any previous value.
-	as_record_set_int64(&rec, "test-bin", id);
-	
-	// Write a record to the database.
-	as_error err;
-	if (aerospike_key_put_async(&as, &err, NULL, &key, &rec, write_listener, counter, event_loop, counter->pipe_listener) != AEROSPIKE_OK) {
-		write_listener(&err, counter, event_loop);
-		return false;
-	}
-	return true;
+	warm_up_start(w, &as, event_loop, g_namespace, g_set, g_warm_keys, g_warm_key_count, warm_up_done, NULL);
 }
 
 static void
-pipeline_listener(void* udata, as_event_loop* event_loop)
+warm_up_connections(void)
 {
-	counter* counter = udata;
-	
-	// Check if pipeline has space.
-	if (counter->pipe_count < counter->queue_size && counter->next_id < counter->max) {
-		// Issue another write.
-		counter->pipe_count++;
-		write_record(event_loop, counter);
-	}
-}
+	// Each concurrent async command needs its own connection, so conns
+	// concurrent reads per node open that many connections. Keys are drawn
+	// until each node masters exactly conns of them.
+	route_table t;
 
-static void
-write_listener(as_error* err, void* udata, as_event_loop* event_loop)
-{
-	counter* counter = udata;
-	
-	if (err) {
-		printf("aerospike_key_put_async() returned %d - %s\n", err->code, err->message);
-		as_monitor_notify(&app_complete_monitor);
+	if (! route_table_init(&t, &as, g_namespace, PARTITION_COUNT, 1)) {
+		printf("Warm-up skipped: no partition table for namespace %s\n", g_namespace);
 		return;
 	}
 
-	// Atomic increment is not necessary since only one event loop is used.
-	if (++counter->count == counter->max) {
-		// We have written all records.
-		printf("Wrote %u records\n", counter->count);
-		
-		// Records can now be read in a batch.
-		batch_read(event_loop, counter->max);
-		return;
-	}
-	
-	// Check if we need to write another record.
-	if (counter->next_id < counter->max) {
-		write_record(event_loop, counter);
+	uint32_t node_count = t.node_count;
+	uint32_t* node_keys = calloc(node_count, sizeof(uint32_t));
+	uint64_t target = (uint64_t)g_warm_conns * node_count;
+	uint64_t seed = 0xD1B54A32D192ED03ULL;
+
+	g_warm_keys = malloc(sizeof(int64_t) * target);
+	g_warm_key_count = 0;
+
+	// A node that masters no partitions never fills its share, so give up
+	// after far more draws than a balanced map needs.
+	for (uint64_t draws = 0; g_warm_key_count < target && draws < target * 100; draws++) {
+		int64_t id = (int64_t)(random_next(&seed) >> 1);
+		as_key key;
+
+		as_key_init_int64(&key, g_namespace, g_set, id);
+
+		uint32_t node = route_node(&t, &key);
+
+		if (node < node_count && node_keys[node] < g_warm_conns) {
+			node_keys[node]++;
+			g_warm_keys[g_warm_key_count++] = id;
+		}
+	}
+
+	if (g_warm_key_count == 0) {
+		// Nothing to send, so no loop would ever finish.
+		printf("Warm-up skipped: no node masters a partition of namespace %s\n", g_namespace);
+		free(g_warm_keys);
+		free(node_keys);
+		route_table_destroy(&t);
+		return;
+	}
+
+	g_warm_ups = calloc(g_loop_count, sizeof(warm_up));
+	g_warm_remaining = g_loop_count;
+	as_monitor_init(&warm_up_monitor);
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		as_event_execute(as_event_loop_get_by_index(i), start_warm_up, &g_warm_ups[i]);
+	}
+	as_monitor_wait(&warm_up_monitor);
+	as_monitor_destroy(&warm_up_monitor);
+
+	histogram* cold = malloc(sizeof(histogram));
+	histogram* warm = malloc(sizeof(histogram));
+	uint64_t slowest = 0;
+	uint64_t errors = 0;
+
+	histogram_init(cold);
+	histogram_init(warm);
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		warm_up* w = &g_warm_ups[i];
+
+		histogram_merge(cold, &w->cold);
+		histogram_merge(warm, &w->warm);
+		errors += w->errors;
+
+		if (w->end - w->begin > slowest) {
+			slowest = w->end - w->begin;
+		}
+		warm_up_destroy(w);
+	}
+
+	// Cold start cost gets its own lines, away from the workload's latency.
+	printf("Warm-up: %u connections to %u nodes per loop in %.3fms, %llu errors\n",
+		g_warm_key_count, node_count, slowest / 1000000.0, (unsigned long long)errors);
+
+	for (uint32_t i = 0; i < node_count; i++) {
+		printf("Warm-up: %u connections per loop to node %s\n", node_keys[i], t.node_names[i]);
+	}
+	histogram_print(cold, "Warm-up connect + read");
+	histogram_print(warm, "Warm-up read");
+	printf("Connect cost: p50=%.1fus p99=%.1fus\n",
+		((double)histogram_percentile(cold, 50.0) - (double)histogram_percentile(warm, 50.0)) / 1000.0,
+		((double)histogram_percentile(cold, 99.0) - (double)histogram_percentile(warm, 99.0)) / 1000.0);
+	free(cold);
+	free(warm);
+	free(g_warm_ups);
+	free(g_warm_keys);
+	free(node_keys);
+	route_table_destroy(&t);
+}
+
+static void*
+submit_thread(void* udata)
+{
+	// Producer p generates keys p, p + producers, ... and hands each command
+	// to the event loop that owns its key, as an application thread would.
+	uint32_t p = (uint32_t)(uintptr_t)udata;
+	uint64_t seed = 0xC2B2AE3D27D4EB4FULL * (p + 1);
+	uint64_t pushes = 0;
+	uint64_t k = p;
+
+	while (true) {
+		if (k >= g_max_records) {
+			if (! g_benchmark || p >= g_max_records) {
+				break;
+			}
+			// Benchmark mode cycles through the key range.
+			k = p;
+		}
+
+		if (g_benchmark && (pushes & 63) == 0 && histogram_now() >= g_end) {
+			break;
+		}
+
+		if (as_load_uint32(&g_shutdown)) {
+			break;
+		}
+
+		uint32_t i = (uint32_t)(((k + 1) * g_loop_count - 1) / g_max_records);
+		counter* counter = g_counters[i];
+		submit_desc desc = {.id = (int64_t)k, .op = SUBMIT_WRITE};
+
+		if (g_mixed) {
+			// Same key and operation choice as issue_command().
+			uint32_t range = counter->max - counter->begin;
+			desc.id = counter->begin + shard_offset(distribution_next(&g_keys, &seed), range);
+
+			if (random_next(&seed) % 100 < g_read_percent) {
+				desc.op = SUBMIT_READ;
+			}
+		}
+
+		desc.enqueued = histogram_now();
+
+		while (! submit_queue_push(&counter->submit, &desc)) {
+			// Loop is behind. Back off without holding anything it needs.
+			// Counted before the push, so the report sees every stall.
+			as_incr_uint64(&g_submit_full);
+			sched_yield();
+		}
+		pushes++;
+		k += g_submit_threads;
+	}
+
+	if (as_aaf_uint32(&g_producers_remaining, -1) == 0) {
+		// Notifiers are removed in their own loops, after the last notify.
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			as_event_execute(g_counters[i]->event_loop, submit_close, g_counters[i]);
+		}
+	}
+	return NULL;
+}
+
+static void
+start_producers(void)
+{
+	// Wait for every loop's ring and notifier.
+	as_monitor_wait(&submit_ready_monitor);
+	as_monitor_destroy(&submit_ready_monitor);
+
+	g_producers = calloc(g_submit_threads, sizeof(pthread_t));
+	g_producers_remaining = g_submit_threads;
+
+	for (uint32_t i = 0; i < g_submit_threads; i++) {
+		if (pthread_create(&g_producers[i], NULL, submit_thread, (void*)(uintptr_t)i) != 0) {
+			// Keys are striped across producers, so the run can not finish without it.
+			printf("Failed to create producer thread\n");
+			exit(-1);
+		}
+	}
+}
+
+static void
+wait_complete(void)
+{
+	int sig;
+
+	while (sigwait(&g_signals, &sig) == 0 && sig != SIGUSR1) {
+		if (! shutdown_begin(sig == SIGINT ? "interrupted" : "terminated")) {
+			// Drain is already under way. Do not wait for it.
+			printf("Interrupted again, exiting\n");
+			exit(-1);
+		}
+	}
+}
+
+static bool
+shutdown_begin(const char* reason)
+{
+	// Callable from any thread. Only the first caller starts the drain.
+	if (! as_cas_uint32(&g_shutdown, 0, 1)) {
+		return false;
+	}
+
+	g_shutdown_reason = reason;
+	g_shutdown_time = histogram_now();
+	printf("Shutdown: %s, draining commands in flight\n", reason);
+
+	// Loops see g_shutdown and stop issuing straight away. Each one is
+	// closed by drain_loop() or by its last completion, in its own thread.
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		as_event_loop* event_loop = as_event_loop_get_by_index(i);
+		as_event_execute(event_loop, drain_loop, event_loop);
+	}
+	return true;
+}
+
+static void
+drain_loop(void* udata)
+{
+	as_event_loop* event_loop = udata;
+	counter* counter = g_counters[event_loop->index];
+
+	if (! counter || counter->state != LOOP_RUNNING) {
+		// Not started yet, so start_writes() will see the shutdown, or
+		// already closed.
+		return;
+	}
+
+	counter->state = LOOP_DRAINING;
+	counter->drain_begin = histogram_now();
+	counter->drain_inflight = counter->inflight + counter->batch_inflight;
+	stop_throttle(counter);
+
+	if (g_rate > 0 && ! counter->send_done) {
+		counter->send_done = true;
+		loop_timer_close(&counter->send_timer);
+	}
+
+	if (g_export_path) {
+		// The scan stops at the end of its current page, and export_drain()
+		// closes the loop once the writer is done.
+		return;
+	}
+	drain_check(counter);
+}
+
+static void
+notify_complete(void)
+{
+	// Last loop has closed. Wake wait_complete() in main.
+	pthread_kill(g_main_thread, SIGUSR1);
+}
+
+static void
+drain_check(counter* counter)
+{
+	// Commands backing off before a retry are still in flight, so they are
+	// sent and completed rather than dropped.
+	if (counter->state != LOOP_DRAINING || counter->inflight > 0 || counter->batch_inflight > 0) {
+		return;
+	}
+
+	if (g_submit_threads > 0 && ! counter->producers_done) {
+		// submit_close() checks again.
+		return;
+	}
+	loop_complete(counter);
+}
+
+static void
+start_writes(void* udata)
+{
+	// Running in the event loop thread that will own this counter shard.
+	// Allocating it here places the shard on this thread's NUMA node.
+	as_event_loop* event_loop = udata;
+	uint32_t i = event_loop->index;
+	counter* counter = affinity_alloc_local(sizeof(*counter));
+
+	counter->event_loop = event_loop;
+	loop_stats_start(&counter->stats, event_loop->loop);
+	counter->begin = (uint32_t)((uint64_t)g_max_records * i / g_loop_count);
+	counter->next_id = counter->begin;
+	counter->max = (uint32_t)((uint64_t)g_max_records * (i + 1) / g_loop_count);
+	counter->seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+
+	if (g_load_path) {
+		// Input is split by bytes instead of keys.
+		counter->begin = counter->next_id = counter->max = 0;
+		counter->load_pos = g_load_bounds[i];
+		counter->load_end = g_load_bounds[i + 1];
+	}
+	else if (g_route) {
+		// Shard range indexes this loop's keys in the grouped key list.
+		counter->begin = counter->next_id = g_routes.loop_begin[i];
+		counter->max = g_routes.loop_begin[i + 1];
+	}
+
+	if (! g_export_path) {
+		counter->node_commands = affinity_alloc_local(sizeof(uint64_t) * (g_routes.node_count + 1));
+	}
+	histogram_init(&counter->write_latency);
+	histogram_init(&counter->read_latency);
+	histogram_init(&counter->batch_latency);
+
+	if (g_pipeline) {
+		// Demonstrate pipelined writes.
+		// Pipeline queue size (1000) is greater because sockets are shared.
+		counter->queue_size = PIPELINE_QUEUE_SIZE;
+		counter->pipe_listener = pipeline_listener;
+	}
+	else {
+		// Demonstrate async non-pipelined writes.
+		// Async queue size (100) is less because there is one socket per concurrent command.
+		counter->queue_size = ASYNC_QUEUE_SIZE;
+		counter->pipe_listener = NULL;
+	}
+
+	if (g_adaptive) {
+		// Start from the hand-picked queue size. Async windows are capped by
+		// connections, since each concurrent async command needs its own socket.
+		uint32_t max = g_pipeline ? PIPELINE_QUEUE_SIZE * 10 : MAX_CONNS_PER_LOOP;
+		window_init(&counter->window, counter->queue_size, 1, max, g_latency_target);
+		command_pool_init(&counter->pool, counter, max);
+	}
+	else {
+		command_pool_init(&counter->pool, counter, counter->queue_size);
+	}
+	g_counters[i] = counter;
+
+	retry_queue_init(&counter->retry, event_loop);
+
+	if (g_export_path) {
+		start_export(counter);
+		return;
+	}
+
+	if (g_throttle > 0) {
+		start_throttle(counter);
+	}
+
+	if (g_benchmark && i == 0) {
+		start_reporter(event_loop);
+	}
+
+	if (g_submit_threads > 0) {
+		start_submit(counter);
+		return;
+	}
+
+	if (! has_more_writes(counter, 0)) {
+		// More event loops than records. Nothing to do for this shard.
+		loop_complete(counter);
+		return;
+	}
+
+	if (g_rate > 0) {
+		start_open_loop(counter);
+	}
+	else if (g_coro) {
+		start_workers(counter);
+	}
+	else if (counter->pipe_listener) {
+		write_records_pipeline(counter);
+	}
+	else {
+		write_records_async(counter);
+	}
+
+	// Input range may have had only malformed records.
+	load_check_done(counter);
+}
+
+static void
+write_records_pipeline(counter* counter)
+{
+	// Prime pipeline to its full depth straight away, rather than writing a
+	// single record and ramping up one command per pipeline_listener callback.
+	// Commands stay on the shard's own event loop, so its counter is never shared.
+	counter->ramp_begin = histogram_now();
+	fill_pipeline(counter);
+	counter->ramp_target = counter->pipe_count;
+
+	if (counter->sent >= counter->ramp_target) {
+		// Commands were sent while priming.
+		counter->ramp_time = histogram_now() - counter->ramp_begin;
+	}
+}
+
+static void
+fill_pipeline(counter* counter)
+{
+	while (counter->pipe_count < counter->queue_size && has_more_writes(counter, 0) && take_token(counter)) {
+		counter->pipe_count++;
+
+		if (! issue_command(counter->event_loop, counter)) {
+			counter->pipe_count--;
+			issue_failed(counter);
+			break;
+		}
+	}
+}
+
+static void
+send_timer_fired(void* udata)
+{
+	counter* counter = udata;
+
+	send_due(counter->event_loop, counter, histogram_now());
+
+	if (counter->send_done && counter->inflight == 0) {
+		// Schedule ended with nothing inflight, so no completion will start
+		// the batch read.
+		batch_read(counter->event_loop, counter);
+	}
+}
+
+static void
+start_open_loop(counter* counter)
+{
+	uint32_t i = counter->event_loop->index;
+
+	counter->send_interval = (uint64_t)(1000000000.0 * g_loop_count / g_rate);
+
+	// Stagger constant rate loops, so they do not all send at once.
+	counter->next_send = histogram_now() + counter->send_interval * i / g_loop_count;
+	loop_timer_init(&counter->send_timer, counter->event_loop, send_timer_fired, counter);
+	send_due(counter->event_loop, counter, histogram_now());
+}
+
+static void
+send_due(as_event_loop* event_loop, counter* counter, uint64_t now)
+{
+	if (counter->send_done || as_load_uint32(&g_shutdown)) {
+		// drain_loop() closes the send timer.
+		return;
+	}
+
+	// Send every command whose intended send time has passed, as long as the
+	// window has room. Commands that do not fit stay due, and are sent with
+	// their original intended time as completions free the window.
+	while (counter->next_send <= now && now < g_end && counter->inflight < counter->queue_size) {
+		counter->intended = counter->next_send;
+
+		if (g_poisson) {
+			// Exponential gaps between sends.
+			counter->next_send += (uint64_t)(-log(1.0 - random_next_double(&counter->seed)) * counter->send_interval);
+		}
+		else {
+			counter->next_send += counter->send_interval;
+		}
+
+		if (! issue_command(event_loop, counter)) {
+			// The schedule has moved past it, so it will never be sent.
+			// Carry on, so the loop does not wait on a backlog with nothing
+			// in flight.
+			counter->missed++;
+		}
+	}
+
+	if (now >= g_end) {
+		// Schedule is over. Anything still due was never sent.
+		if (counter->next_send < g_end) {
+			counter->missed += (g_end - counter->next_send) / counter->send_interval + 1;
+		}
+		counter->backlog = 0;
+		counter->send_done = true;
+		loop_timer_close(&counter->send_timer);
+		return;
+	}
+
+	if (counter->next_send <= now) {
+		// Fallen behind. Completions will send the backlog.
+		uint64_t lag = now - counter->next_send;
+
+		counter->backlog = lag / counter->send_interval + 1;
+
+		if (lag > counter->lag_max) {
+			counter->lag_max = lag;
+		}
+		return;
+	}
+
+	// Wake up at the next send, or at the end of the schedule.
+	uint64_t wake = counter->next_send < g_end ? counter->next_send : g_end;
+
+	counter->backlog = 0;
+	loop_timer_start(&counter->send_timer, (wake - now + 999) / 1000, 0);
+}
+
+static void
+refill_tokens(void* udata)
+{
+	counter* counter = udata;
+	uint64_t now = histogram_now();
+
+	// Refill by elapsed time rather than ticks, so timer jitter does not
+	// change the rate. Fractional tokens carry over to the next refill.
+	counter->tokens += (now - counter->refill_time) * counter->token_rate;
+	counter->refill_time = now;
+
+	if (counter->tokens > counter->tokens_max) {
+		counter->tokens = counter->tokens_max;
+	}
+
+	if (! has_more_writes(counter, now)) {
+		counter->throttle_end = now;
+		stop_throttle(counter);
+
+		if (g_benchmark && counter->inflight == 0 && ! counter->chunks) {
+			// Ran out of time while waiting for tokens, so no completion
+			// will start the batch read.
+			batch_read(counter->event_loop, counter);
+		}
+		else {
+			load_check_done(counter);
+		}
+		return;
+	}
+
+	// Issue writes that were deferred for lack of tokens.
+	resume_writes(counter, now);
+}
+
+static void
+start_throttle(counter* counter)
+{
+	counter->token_rate = g_throttle / g_loop_count / 1000000000.0;
+	counter->tokens_max = counter->token_rate * THROTTLE_BURST_NS;
+
+	if (counter->tokens_max < 1.0) {
+		counter->tokens_max = 1.0;
+	}
+
+	// Start with one refill period of tokens.
+	counter->tokens = counter->token_rate * THROTTLE_TICK_US * 1000;
+	counter->refill_time = histogram_now();
+	counter->throttle_active = true;
+	loop_timer_init(&counter->refill_timer, counter->event_loop, refill_tokens, counter);
+	loop_timer_start(&counter->refill_timer, THROTTLE_TICK_US, THROTTLE_TICK_US);
+}
+
+static void
+stop_throttle(counter* counter)
+{
+	if (counter->throttle_active) {
+		counter->throttle_active = false;
+		loop_timer_close(&counter->refill_timer);
+	}
+}
+
+static bool
+take_token(counter* counter)
+{
+	if (g_throttle == 0) {
+		return true;
+	}
+
+	if (counter->tokens < 1.0) {
+		// Out of tokens. The write is deferred until the next refill.
+		return false;
+	}
+	counter->tokens -= 1.0;
+	return true;
+}
+
+static void
+resume_writes(counter* counter, uint64_t now)
+{
+	if (counter->pipe_listener) {
+		while (counter->pipe_count < counter->queue_size && has_more_writes(counter, now) && take_token(counter)) {
+			counter->pipe_count++;
+
+			if (! issue_command(counter->event_loop, counter)) {
+				counter->pipe_count--;
+				break;
+			}
+		}
+	}
+	else {
+		fill_window(counter->event_loop, counter, now);
+	}
+}
+
+static void
+submit_notified(void* udata)
+{
+	counter* counter = udata;
+
+	counter->wakeups++;
+	submit_drain(counter);
+}
+
+static void
+start_submit(counter* counter)
+{
+	histogram_init(&counter->submit_latency);
+	counter->notifier = g_backend.add_notifier(counter->event_loop->loop, submit_notified, counter);
+
+	if (! submit_queue_init(&counter->submit, SUBMIT_RING_SIZE, g_backend.notify, counter->notifier)) {
+		printf("Failed to allocate submit ring\n");
+		exit(-1);
+	}
+
+	if (as_aaf_uint32(&g_submit_remaining, -1) == 0) {
+		as_monitor_notify(&submit_ready_monitor);
+	}
+
+	if (! has_more_writes(counter, 0)) {
+		// More event loops than records. No producer will push to this loop.
+		loop_complete(counter);
+	}
+}
+
+static void
+submit_drain(counter* counter)
+{
+	as_event_loop* event_loop = counter->event_loop;
+	submit_desc descs[SUBMIT_BATCH];
+
+	while (true) {
+		uint64_t now = histogram_now();
+		bool ended = (g_benchmark && now >= g_end) || as_load_uint32(&g_shutdown);
+		uint32_t room = SUBMIT_BATCH;
+
+		if (! ended) {
+			// Leave commands in the ring while the window is full. The next
+			// completion drains them, so a full window does not cost wakeups.
+			room = counter->inflight < counter->queue_size ? counter->queue_size - counter->inflight : 0;
+
+			if (room == 0) {
+				break;
+			}
+
+			if (room > SUBMIT_BATCH) {
+				room = SUBMIT_BATCH;
+			}
+		}
+
+		uint32_t n = submit_queue_pop(&counter->submit, descs, room);
+
+		if (n == 0) {
+			if (submit_queue_rearm(&counter->submit)) {
+				continue;
+			}
+			break;
+		}
+
+		if (ended) {
+			// Producers stop on their next clock or shutdown check. Drop what
+			// they pushed after the end.
+			continue;
+		}
+
+		for (uint32_t i = 0; i < n; i++) {
+			submit_desc* desc = &descs[i];
+
+			if (now >= g_warmup_end) {
+				histogram_add(&counter->submit_latency, now - desc->enqueued);
+			}
+			counter->submitted++;
+
+			if (desc->op == SUBMIT_READ) {
+				read_record(event_loop, counter, desc->id);
+			}
+			else {
+				write_record(event_loop, counter, desc->id);
+			}
+		}
+	}
+
+	if (as_load_uint32(&g_shutdown)) {
+		drain_check(counter);
+	}
+	else if (counter->producers_done && counter->inflight == 0 && ! counter->submit_finished) {
+		// Every command has been issued and has drained. Without a benchmark,
+		// command_complete() ends the shard on its last completion, which
+		// never comes if the last commands failed synchronously.
+		counter->submit_finished = true;
+		batch_read(event_loop, counter);
+	}
+}
+
+static void
+submit_close(void* udata)
+{
+	// Every producer has exited, so nothing can notify any more.
+	counter* counter = udata;
+
+	counter->producers_done = true;
+	g_backend.remove_notifier(counter->notifier);
+	submit_drain(counter);
+}
+
+static void
+start_workers(counter* counter)
+{
+	// One worker per window slot. All are counted before the first runs, so
+	// a worker that finds nothing to do can not end the loop early.
+	uint32_t n = counter->queue_size;
+
+	coro_arena_init(&counter->coros, &as, counter->event_loop, sizeof(worker), n);
+	counter->workers = n;
+
+	for (uint32_t i = 0; i < n; i++) {
+		worker* w = (worker*)coro_spawn(&counter->coros, worker_run, NULL);
+
+		w->counter = counter;
+		coro_wake(&w->co);
+	}
+}
+
+static void
+worker_run(coro* co)
+{
+	// Same workload as the listener chain, written as one loop. Everything
+	// that lives across an await is in the frame.
+	worker* w = (worker*)co;
+	counter* counter = w->counter;
+
+	CORO_BEGIN(co);
+
+	while (has_more_writes(counter, 0)) {
+		worker_issue(w);
+
+		while (true) {
+			counter->issued++;
+
+			if (w->cmd->read) {
+				CORO_AWAIT(co, coro_get(co, NULL, &w->cmd->key));
+			}
+			else {
+				CORO_AWAIT(co, coro_put(co, NULL, &w->cmd->key, &w->cmd->record));
+			}
+
+			if (co->status == AEROSPIKE_OK || (w->cmd->read && co->status == AEROSPIKE_ERR_RECORD_NOT_FOUND) ||
+				! schedule_retry(counter, &w->cmd->timer, &w->cmd->attempts, co->status, coro_wake, co)) {
+				break;
+			}
+
+			// Back off with the window slot held. Latency is measured from
+			// the first attempt.
+			CORO_YIELD(co);
+		}
+		worker_finish(w);
+	}
+
+	CORO_END(co);
+
+	if (--counter->workers > 0) {
+		return;
+	}
+
+	if (as_load_uint32(&g_shutdown)) {
+		drain_check(counter);
+		return;
+	}
+
+	// Benchmark has ended, or every key in the shard's range has been
+	// issued once. Batch reads stay on listener callbacks.
+	batch_read(counter->event_loop, counter);
+}
+
+static void
+worker_issue(worker* w)
+{
+	// Each worker holds at most one command and the pool has one per
+	// worker, so acquire can not fail.
+	counter* counter = w->counter;
+	int64_t id;
+	bool read = next_key(counter, &id);
+	command* cmd = command_acquire(counter, id);
+
+	cmd->read = read;
+
+	if (! read) {
+		set_bins(cmd, id);
+	}
+	counter->inflight++;
+	counter->node_commands[route_node(&g_routes, &cmd->key)]++;
+	w->cmd = cmd;
+}
+
+static void
+worker_finish(worker* w)
+{
+	// Count the result as write_listener() and read_response() do.
+	counter* counter = w->counter;
+	command* cmd = w->cmd;
+	as_status status = w->co.status;
+	uint64_t now = histogram_now();
+	uint64_t latency = now - cmd->begin;
+
+	if (cmd->read) {
+		if (status == AEROSPIKE_OK || ! read_error(counter, w->co.err)) {
+			counter->reads++;
+
+			if (now >= g_warmup_end) {
+				histogram_add(&counter->read_latency, latency);
+			}
+		}
+	}
+	else if (status != AEROSPIKE_OK) {
+		write_error(counter, w->co.err);
+	}
+	else {
+		counter->count++;
+
+		if (now >= g_warmup_end) {
+			histogram_add(&counter->write_latency, latency);
+		}
+	}
+	command_release(cmd);
+	w->cmd = NULL;
+	counter->inflight--;
+}
+
+static void
+write_records_async(counter* counter)
+{
+	// Use shard's event loop for all of its records.
+	// Write queue_size commands on the async queue.
+	fill_window(counter->event_loop, counter, 0);
+}
+
+static void
+fill_window(as_event_loop* event_loop, counter* counter, uint64_t now)
+{
+	// Issue commands until queue_size commands are inflight.
+	while (counter->inflight < counter->queue_size && has_more_writes(counter, now) && take_token(counter)) {
+		if (! issue_command(event_loop, counter)) {
+			issue_failed(counter);
+			break;
+		}
+	}
+}
+
+static void
+issue_failed(counter* counter)
+{
+	// The failed command's listener will not be called. With nothing else in
+	// flight, no completion will issue again or finish the shard either.
+	// Open-loop mode has its send timer.
+	if (counter->inflight > 0 || g_rate > 0) {
+		return;
+	}
+
+	if (! counter->stall_active) {
+		loop_timer_init(&counter->stall_timer, counter->event_loop, stall_fired, counter);
+		counter->stall_active = true;
+	}
+	loop_timer_start(&counter->stall_timer, STALL_RETRY_US, 0);
+}
+
+static void
+stall_fired(void* udata)
+{
+	counter* counter = udata;
+
+	if (counter->state == LOOP_CLOSED || counter->inflight > 0) {
+		return;
+	}
+
+	if (as_load_uint32(&g_shutdown)) {
+		drain_check(counter);
+		return;
+	}
+
+	if (! has_more_writes(counter, 0)) {
+		// The failed issue was the shard's last.
+		if (g_load_path) {
+			load_check_done(counter);
+		}
+		else {
+			batch_read(counter->event_loop, counter);
+		}
+		return;
+	}
+
+	// Calls issue_failed() again if this issue fails too.
+	if (counter->pipe_listener) {
+		// Ramp-up has already been measured, since nothing is in flight.
+		fill_pipeline(counter);
+	}
+	else {
+		fill_window(counter->event_loop, counter, 0);
+	}
+}
+
+static inline uint32_t
+shard_offset(uint64_t sample, uint32_t range)
+{
+	// Shards can be shorter than the range g_keys was sized for. Scaling
+	// keeps the distribution's shape, where wrapping would pile the top of
+	// the range onto the shard's first keys.
+	return (uint32_t)(sample * range / (g_keys.max + 1));
+}
+
+static inline int64_t
+shard_key(uint32_t index)
+{
+	return g_route ? g_routes.keys[index] : index;
+}
+
+static bool
+issue_command(as_event_loop* event_loop, counter* counter)
+{
+	if (g_load_path) {
+		return load_record(event_loop, counter);
+	}
+
+	int64_t id;
+
+	if (next_key(counter, &id)) {
+		return read_record(event_loop, counter, id);
+	}
+	return write_record(event_loop, counter, id);
+}
+
+static bool
+next_key(counter* counter, int64_t* id)
+{
+	// Pick the next command's key. Returns true if the command is a read.
+	if (counter->next_id == counter->max) {
+		// Benchmark mode cycles through the key range.
+		counter->next_id = counter->begin;
+	}
+
+	*id = shard_key(counter->next_id++);
+
+	if (! g_mixed) {
+		return false;
+	}
+
+	// Mixed mode draws keys from the key distribution. next_id still counts
+	// commands, so a non-benchmark run issues one command per key.
+	uint32_t range = counter->max - counter->begin;
+	*id = shard_key(counter->begin + shard_offset(distribution_next(&g_keys, &counter->seed), range));
+	return random_next(&counter->seed) % 100 < g_read_percent;
+}
+
+static void
+command_pool_init(command_pool* pool, counter* counter, uint32_t capacity)
+{
+	pool->commands = affinity_alloc_local(sizeof(command) * capacity);
+	pool->values = g_load_path ? affinity_alloc_local(sizeof(as_bin_value) * g_bin_count * capacity) : NULL;
+	pool->free_list = NULL;
+	pool->capacity = capacity;
+
+	for (uint32_t i = capacity; i > 0; i--) {
+		command* cmd = &pool->commands[i - 1];
+		cmd->counter = counter;
+
+		// Namespace and set are copied into the key once. Only the user key
+		// changes per command.
+		as_key_init_int64(&cmd->key, g_namespace, g_set, 0);
+		as_record_init(&cmd->record, g_bin_count);
+		cmd->values = pool->values ? pool->values + (size_t)(i - 1) * g_bin_count : NULL;
+		cmd->next = pool->free_list;
+		pool->free_list = cmd;
+	}
+}
+
+static void
+command_pool_destroy(command_pool* pool)
+{
+	for (uint32_t i = 0; i < pool->capacity; i++) {
+		// Bin values are owned by the value arena or the input mapping. Drop them before
+		// destroying the record's bin storage.
+		pool->commands[i].record.bins.size = 0;
+		as_record_destroy(&pool->commands[i].record);
+	}
+	affinity_free_local(pool->commands);
+
+	if (pool->values) {
+		affinity_free_local(pool->values);
+	}
+}
+
+static command*
+command_acquire(counter* counter, int64_t id)
+{
+	command_pool* pool = &counter->pool;
+	command* cmd = pool->free_list;
+
+	if (! cmd) {
+		return NULL;
+	}
+
+	pool->free_list = cmd->next;
+
+	// Open-loop latency starts when the command should have been sent, so
+	// time spent behind schedule is not hidden.
+	cmd->begin = counter->intended ? counter->intended : histogram_now();
+
+	// Reset the user key in place. This is what as_key_init_int64() does,
+	// minus copying namespace and set.
+	as_integer_init(&cmd->key.value.integer, id);
+	cmd->key.valuep = &cmd->key.value;
+	cmd->key.digest.init = false;
+	cmd->attempts = 0;
+	cmd->outstanding = 0;
+	cmd->read = false;
+	cmd->answered = false;
+	cmd->error = false;
+	return cmd;
+}
+
+static void
+command_release(command* cmd)
+{
+	command_pool* pool = &cmd->counter->pool;
+
+	cmd->next = pool->free_list;
+	pool->free_list = cmd;
+}
+
+static bool
+write_record(as_event_loop* event_loop, counter* counter, int64_t id)
+{
+	command* cmd = command_acquire(counter, id);
+
+	if (! cmd) {
+		// Window is larger than the pool. Wait for a completion.
+		return false;
+	}
+	set_bins(cmd, id);
+	return put_command(event_loop, counter, cmd);
+}
+
+static void
+set_bins(command* cmd, int64_t id)
+{
+	// The pooled record already has storage for g_bin_count bins. Bin values
+	// either are integers or point into the pre-generated value arena, so the
+	// record is never destroyed between commands.
+	as_record* rec = &cmd->record;
+	uint64_t bytes = 0;
+	rec->bins.size = 0;
+	
+	for (uint32_t i = 0; i < g_bin_count; i++) {
+		uint64_t value = (uint64_t)id * g_bin_count + i;
+
+		value_arena_set_bin(&g_values, rec, g_bin_names[i], value);
+		bytes += value_arena_value_size(&g_values, value);
+	}
+	cmd->counter->write_bytes += bytes;
+}
+
+static bool
+load_record(as_event_loop* event_loop, counter* counter)
+{
+	command* cmd = command_acquire(counter, 0);
+
+	if (! cmd) {
+		// Window is larger than the pool. Wait for a completion.
+		return false;
+	}
+
+	// Parse straight from the mapping. Keys and bin values wrap the mapped
+	// bytes, so nothing is copied.
+	loader_value values[g_bin_count];
+	loader_record input = {.bins = values};
+	int rv;
+
+	while ((rv = loader_next(&g_load, &counter->load_pos, counter->load_end, &input, g_bin_count)) < 0) {
+		counter->malformed++;
+	}
+
+	if (rv == 0) {
+		// End of this loop's input range.
+		command_release(cmd);
+		return false;
+	}
+
+	switch (input.key.type) {
+		case LOADER_INT:
+			as_integer_init(&cmd->key.value.integer, input.key.integer);
+			break;
+		case LOADER_STRING:
+			as_string_init_wlen(&cmd->key.value.string, (char*)input.key.data, input.key.size, false);
+			break;
+		default:
+			as_bytes_init_wrap(&cmd->key.value.bytes, (uint8_t*)input.key.data, input.key.size, false);
+			break;
+	}
+
+	as_record* rec = &cmd->record;
+	rec->bins.size = 0;
+
+	for (uint32_t i = 0; i < input.n_bins; i++) {
+		loader_value* in = &input.bins[i];
+		as_bin_value* v = &cmd->values[i];
+
+		counter->write_bytes += in->type == LOADER_INT ? 8 : in->size;
+
+		switch (in->type) {
+			case LOADER_INT:
+				as_integer_init(&v->integer, in->integer);
+				as_record_set_integer(rec, g_bin_names[i], &v->integer);
+				break;
+			case LOADER_STRING:
+				as_string_init_wlen(&v->string, (char*)in->data, in->size, false);
+				as_record_set_string(rec, g_bin_names[i], &v->string);
+				break;
+			default:
+				as_bytes_init_wrap(&v->bytes, (uint8_t*)in->data, in->size, false);
+				as_record_set_bytes(rec, g_bin_names[i], &v->bytes);
+				break;
+		}
+	}
+	return put_command(event_loop, counter, cmd);
+}
+
+static bool
+put_command(as_event_loop* event_loop, counter* counter, command* cmd)
+{
+	// Write a record to the database.
+	as_record* rec = &cmd->record;
+	as_error err;
+	counter->inflight++;
+	counter->issued++;
+	counter->node_commands[route_node(&g_routes, &cmd->key)]++;
+
+	if (aerospike_key_put_async(&as, &err, NULL, &cmd->key, rec, write_listener, cmd, event_loop, counter->pipe_listener) != AEROSPIKE_OK) {
+		// Command was not queued, so its listener will not be called.
+		counter->inflight--;
+		command_release(cmd);
+		write_error(counter, &err);
+		return false;
+	}
+	return true;
+}
+
+static void
+load_check_done(counter* counter)
+{
+	if (g_load_path && counter->inflight == 0 && ! has_more_writes(counter, 0)) {
+		// This loop's input range is loaded. Keys come from the file, so
+		// there is no key range to batch read.
+		loop_complete(counter);
+	}
+}
+
+static bool
+read_record(as_event_loop* event_loop, counter* counter, int64_t id)
+{
+	command* cmd = command_acquire(counter, id);
+
+	if (! cmd) {
+		// Window is larger than the pool. Wait for a completion.
+		return false;
+	}
+
+	// Read a record from the database.
+	as_error err;
+	counter->inflight++;
+	counter->issued++;
+	counter->node_commands[route_node(&g_routes, &cmd->key)]++;
+	cmd->read = true;
+	cmd->outstanding = 1;
+
+	if (aerospike_key_get_async(&as, &err, NULL, &cmd->key, read_listener, cmd, event_loop, counter->pipe_listener) != AEROSPIKE_OK) {
+		// Command was not queued, so its listener will not be called.
+		counter->inflight--;
+		command_release(cmd);
+		read_error(counter, &err);
+		return false;
+	}
+
+	if (g_hedge && counter->hedge_delay) {
+		retry_queue_add(&counter->retry, &cmd->timer, histogram_now() + counter->hedge_delay, send_hedge, cmd);
+	}
+	return true;
+}
+
+static void
+write_error(counter* counter, as_error* err)
+{
+	counter->errors++;
+	counter->error_codes[stats_code_slot(err->code)]++;
+
+	if (g_benchmark || g_load_path || g_max_retries > 0 || g_submit_threads > 0) {
+		// Keep the run going. Errors are counted and reported.
+		return;
+	}
+
+	printf("aerospike_key_put_async() returned %d - %s\n", err->code, err->message);
+	shutdown_begin("write error");
+}
+
+static bool
+read_error(counter* counter, as_error* err)
+{
+	if (err->code == AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+		// Mixed mode may read keys that have not been written yet.
+		return false;
+	}
+
+	counter->read_errors++;
+	counter->error_codes[stats_code_slot(err->code)]++;
+
+	if (g_benchmark || g_max_retries > 0 || g_submit_threads > 0) {
+		// Keep the run going. Errors are counted and reported.
+		return true;
+	}
+
+	printf("aerospike_key_get_async() returned %d - %s\n", err->code, err->message);
+	shutdown_begin("read error");
+	return true;
+}
+
+static bool
+schedule_retry(counter* counter, retry_entry* entry, uint32_t* attempts, as_status code,
+	retry_callback callback, void* udata)
+{
+	if (! retry_error_retryable(code)) {
+		return false;
+	}
+
+	if (*attempts >= g_max_retries) {
+		if (g_max_retries > 0) {
+			counter->exhausted++;
+		}
+		return false;
+	}
+
+	uint64_t delay = retry_backoff((*attempts)++, RETRY_BASE_US * 1000, RETRY_MAX_US * 1000, &counter->seed);
+
+	retry_queue_add(&counter->retry, entry, histogram_now() + delay, callback, udata);
+	counter->retries++;
+	return true;
+}
+
+static void
+resend_command(void* udata)
+{
+	command* cmd = udata;
+	counter* counter = cmd->counter;
+	as_event_loop* event_loop = counter->event_loop;
+	as_error err;
+
+	// Same key and bins as the failed attempt. Retries are not pipelined, so
+	// they leave pipeline ramp-up accounting alone.
+	counter->issued++;
+
+	if (cmd->read) {
+		cmd->outstanding++;
+
+		if (aerospike_key_get_async(&as, &err, NULL, &cmd->key, read_listener, cmd, event_loop, NULL) != AEROSPIKE_OK) {
+			read_listener(&err, NULL, cmd, event_loop);
+		}
+	}
+	else if (aerospike_key_put_async(&as, &err, NULL, &cmd->key, &cmd->record, write_listener, cmd, event_loop, NULL) != AEROSPIKE_OK) {
+		write_listener(&err, cmd, event_loop);
+	}
+}
+
+static void
+resend_chunk(void* udata)
+{
+	batch_chunk* chunk = udata;
+	as_event_loop* event_loop = chunk->counter->event_loop;
+	as_error err;
+
+	if (aerospike_batch_read_async(&as, &err, NULL, chunk->records, batch_listener, chunk, event_loop) != AEROSPIKE_OK) {
+		chunk_failed(chunk, &err);
+	}
+}
+
+static void
+chunk_failed(batch_chunk* chunk, as_error* err)
+{
+	// The listener moves on to the next chunk, so calling it inline would
+	// recurse once per chunk of a range that keeps failing. Report from the
+	// retry queue instead. Due after now, so a queue pass that is running
+	// ends before it. The chunk stays inflight until then.
+	chunk->error = *err;
+	retry_queue_add(&chunk->counter->retry, &chunk->timer, histogram_now() + 1, report_chunk, chunk);
+}
+
+static void
+report_chunk(void* udata)
+{
+	batch_chunk* chunk = udata;
+
+	batch_listener(&chunk->error, chunk->records, chunk, chunk->counter->event_loop);
+}
+
+static void
+send_hedge(void* udata)
+{
+	command* cmd = udata;
+	counter* counter = cmd->counter;
+	as_event_loop* event_loop = counter->event_loop;
+
+	// The read has not answered within the loop's p95 read latency. Send a
+	// second copy, preferring another replica, and take whichever answers
+	// first.
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.replica = AS_POLICY_REPLICA_ANY;
+
+	as_error err;
+	cmd->outstanding++;
+
+	if (aerospike_key_get_async(&as, &err, &policy, &cmd->key, hedge_listener, cmd, event_loop, NULL) != AEROSPIKE_OK) {
+		// The first copy is still inflight.
+		cmd->outstanding--;
+		return;
+	}
+	counter->hedges++;
+	counter->issued++;
+}
+
+static bool
+has_more_writes(counter* counter, uint64_t now)
+{
+	if (as_load_uint32(&g_shutdown)) {
+		return false;
+	}
+
+	if (g_benchmark) {
+		return (now ? now : histogram_now()) < g_end;
+	}
+
+	if (g_load_path) {
+		return counter->load_pos < counter->load_end;
+	}
+	return counter->next_id < counter->max;
+}
+
+static void
+pipeline_listener(void* udata, as_event_loop* event_loop)
+{
+	command* cmd = udata;
+	counter* counter = cmd->counter;
+
+	if (++counter->sent == counter->ramp_target && counter->ramp_time == 0) {
+		// Every primed command is now on the wire.
+		counter->ramp_time = histogram_now() - counter->ramp_begin;
+	}
+	
+	// Check if pipeline has space. An adaptive window may have grown.
+	// Open-loop sends only follow the schedule.
+	if (g_rate == 0 && counter->pipe_count < counter->queue_size && has_more_writes(counter, 0) &&
+		take_token(counter)) {
+		// Issue another command.
+		counter->pipe_count++;
+
+		if (! issue_command(event_loop, counter)) {
+			counter->pipe_count--;
+		}
+	}
+}
+
+static void
+write_listener(as_error* err, void* udata, as_event_loop* event_loop)
+{
+	command* cmd = udata;
+	counter* counter = cmd->counter;
+	uint64_t begin = cmd->begin;
+	uint64_t now = histogram_now();
+
+	if (err && schedule_retry(counter, &cmd->timer, &cmd->attempts, err->code, resend_command, cmd)) {
+		// The command keeps its window slot while it backs off. Latency is
+		// measured from the first attempt.
+		return;
+	}
+
+	command_release(cmd);
+	
+	if (err) {
+		write_error(counter, err);
+	}
+	else {
+		// Atomic increment is not necessary since each counter shard is only
+		// accessed from its own event loop.
+		counter->count++;
+
+		if (now >= g_warmup_end) {
+			histogram_add(&counter->write_latency, now - begin);
+		}
+	}
+	command_complete(event_loop, counter, now - begin, err != NULL, now);
+}
+
+static void
+read_listener(as_error* err, as_record* record, void* udata, as_event_loop* event_loop)
+{
+	read_response(event_loop, udata, err, false);
+}
+
+static void
+hedge_listener(as_error* err, as_record* record, void* udata, as_event_loop* event_loop)
+{
+	read_response(event_loop, udata, err, true);
+}
+
+static void
+read_response(as_event_loop* event_loop, command* cmd, as_error* err, bool hedge)
+{
+	counter* counter = cmd->counter;
+	uint64_t now = histogram_now();
+
+	cmd->outstanding--;
+
+	if (! cmd->answered) {
+		bool not_found = err && err->code == AEROSPIKE_ERR_RECORD_NOT_FOUND;
+
+		if (err && ! not_found && cmd->outstanding > 0) {
+			// The other copy of a hedged read may still succeed.
+			return;
+		}
+
+		// First answer. A hedge that has not been sent yet is not needed.
+		retry_queue_remove(&counter->retry, &cmd->timer);
+
+		if (err && ! not_found && schedule_retry(counter, &cmd->timer, &cmd->attempts, err->code, resend_command, cmd)) {
+			return;
+		}
+
+		cmd->answered = true;
+		cmd->latency = now - cmd->begin;
+		cmd->error = err && read_error(counter, err);
+
+		if (! cmd->error) {
+			counter->reads++;
+
+			if (now >= g_warmup_end) {
+				histogram_add(&counter->read_latency, cmd->latency);
+			}
+
+			if (g_hedge) {
+				if (hedge) {
+					counter->hedge_wins++;
+				}
+
+				// Hedge delay follows the p95 of recent reads.
+				histogram_add(&counter->hedge_sample, cmd->latency);
+
+				if (counter->hedge_sample.count == HEDGE_WINDOW) {
+					counter->hedge_delay = histogram_percentile(&counter->hedge_sample, 95);
+					histogram_init(&counter->hedge_sample);
+				}
+			}
+		}
+	}
+
+	if (cmd->outstanding > 0) {
+		// The slower copy of a hedged read completes the command, so the
+		// window slot is held until both copies are back.
+		return;
+	}
+
+	uint64_t latency = cmd->latency;
+	bool error = cmd->error;
+
+	command_release(cmd);
+	command_complete(event_loop, counter, latency, error, now);
+}
+
+static void
+command_complete(as_event_loop* event_loop, counter* counter, uint64_t latency, bool error, uint64_t now)
+{
+	if (counter->ramp_time) {
+		// Sample steady-state pipeline depth.
+		counter->depth_sum += counter->inflight;
+		counter->depth_samples++;
+	}
+	counter->inflight--;
+
+	if (g_adaptive) {
+		counter->queue_size = window_update(&counter->window, latency, error);
+	}
+
+	if (as_load_uint32(&g_shutdown)) {
+		// Issue nothing more. The loop closes once its last command is back.
+		drain_check(counter);
+		return;
+	}
+
+	if (! g_benchmark && ! g_load_path &&
+		counter->count + counter->errors + counter->reads + counter->read_errors == counter->max - counter->begin) {
+		// We have issued one command per key in this shard's key range.
+		// Records can now be read in a batch. submit_drain() must not start
+		// it again.
+		counter->submit_finished = true;
+		batch_read(event_loop, counter);
+		return;
+	}
+
+	if (g_submit_threads > 0) {
+		// Replace this command with the next one from the ring.
+		submit_drain(counter);
+		return;
+	}
+	
+	if (g_rate > 0) {
+		// Completions only make room for commands that are already due.
+		send_due(event_loop, counter, now);
+	}
+	else if (counter->pipe_listener) {
+		// Replace this command if the pipeline window still has room.
+		// pipeline_listener() grows the pipeline.
+		if (counter->inflight < counter->queue_size && has_more_writes(counter, now) && take_token(counter)) {
+			if (issue_command(event_loop, counter)) {
+				return;
+			}
+			issue_failed(counter);
+		}
+
+		// There's one fewer command in the pipeline.
+		counter->pipe_count--;
+	}
+	else {
+		// Check if we need to issue more commands. An adaptive window may
+		// have grown or shrunk since the last completion.
+		fill_window(event_loop, counter, now);
+	}
+
+	if (g_benchmark && counter->inflight == 0 && (g_rate == 0 || counter->send_done) &&
+		(g_throttle == 0 || ! has_more_writes(counter, now))) {
+		// Benchmark has ended and this shard's commands have drained.
+		batch_read(event_loop, counter);
+	}
+	else {
+		load_check_done(counter);
+	}
+}
+
+static void
+batch_read(as_event_loop* event_loop, counter* counter)
+{
+	if (g_benchmark) {
+		// Commands stopped being issued at the end of the run.
+		uint64_t now = histogram_now();
+		counter->drain_time = now > g_end ? now - g_end : 0;
+	}
+
+	// Stream the keys this shard inserted in fixed size chunks, keeping
+	// g_batch_inflight chunks inflight so reads overlap with each other.
+	counter->batch_next = counter->begin;
+
+	if (! counter->chunks) {
+		counter->chunks = affinity_alloc_local(sizeof(batch_chunk) * g_batch_inflight);
+
+		for (uint32_t i = 0; i < g_batch_inflight; i++) {
+			counter->chunks[i].counter = counter;
+			counter->chunks[i].records = as_batch_read_create(g_batch_size);
+		}
+	}
+
+	for (uint32_t i = 0; i < g_batch_inflight && counter->batch_next < counter->max; i++) {
+		batch_read_chunk(event_loop, &counter->chunks[i]);
+	}
+
+	if (counter->batch_inflight == 0) {
+		// Nothing to read.
+		loop_complete(counter);
+	}
+}
+
+static void
+batch_read_chunk(as_event_loop* event_loop, batch_chunk* chunk)
+{
+	counter* counter = chunk->counter;
+	as_batch_read_records* records = chunk->records;
+	as_vector* list = &records->list;
+
+	// Release results of the chunk's previous read, but keep its buffer.
+	for (uint32_t i = 0; i < list->size; i++) {
+		as_batch_read_record* record = as_vector_get(list, i);
+		as_key_destroy(&record->key);
+		as_record_destroy(&record->record);
+	}
+	as_vector_clear(list);
+
+	// Make a batch of the next chunk of keys.
+	uint32_t end = counter->batch_next + g_batch_size;
+
+	if (end > counter->max) {
+		end = counter->max;
+	}
+
+	for (uint32_t i = counter->batch_next; i < end; i++) {
+		as_batch_read_record* record = as_batch_read_reserve(records);
+		as_key_init_int64(&record->key, g_namespace, g_set, shard_key(i));
+		record->read_all_bins = true;
+	}
+	counter->batch_next = end;
+	
+	// Read these keys.
+	chunk->begin = histogram_now();
+	chunk->attempts = 0;
+	counter->batch_inflight++;
+
+	as_error err;
+	if (aerospike_batch_read_async(&as, &err, NULL, records, batch_listener, chunk, event_loop) != AEROSPIKE_OK) {
+		chunk_failed(chunk, &err);
+	}
+}
+
+static void
+batch_listener(as_error* err, as_batch_read_records* records, void* udata, as_event_loop* event_loop)
+{
+	batch_chunk* chunk = udata;
+	counter* counter = chunk->counter;
+
+	if (err && schedule_retry(counter, &chunk->timer, &chunk->attempts, err->code, resend_chunk, chunk)) {
+		// Chunk stays inflight while it backs off.
+		return;
+	}
+
+	counter->batch_inflight--;
+
+	if (err) {
+		counter->batch_errors++;
+		counter->error_codes[stats_code_slot(err->code)]++;
+
+		if (g_max_retries == 0) {
+			printf("aerospike_batch_read_async() returned %d - %s\n", err->code, err->message);
+			shutdown_begin("batch read error");
+		}
+
+		// Move on to the next chunk, unless shutdown has begun.
+		batch_next_chunk(event_loop, chunk);
+		return;
+	}
+
+	histogram_add(&counter->batch_latency, histogram_now() - chunk->begin);
+
+	as_vector* list = &records->list;
+
+	uint32_t n_found = 0;
+
+	for (uint32_t i = 0; i < list->size; i++) {
+		as_batch_read_record* record = as_vector_get(list, i);
+
+		if (record->result == AEROSPIKE_OK) {
+			n_found++;
+		}
+		else if (record->result == AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+			// The transaction succeeded but the record doesn't exist.
+			printf("AEROSPIKE_ERR_RECORD_NOT_FOUND\n");
+		}
+		else {
+			// The transaction failed.
+			printf("Error %d\n", record->result);
+		}
+	}
+
+	// Results are reported as each chunk completes.
+	counter->found += n_found;
+	counter->batch_chunks++;
+	batch_next_chunk(event_loop, chunk);
+}
+
+static void
+batch_next_chunk(as_event_loop* event_loop, batch_chunk* chunk)
+{
+	counter* counter = chunk->counter;
+
+	if (as_load_uint32(&g_shutdown)) {
+		drain_check(counter);
+		return;
+	}
+
+	if (counter->batch_next < counter->max) {
+		// Reuse this chunk for the next range of keys.
+		batch_read_chunk(event_loop, chunk);
+		return;
+	}
+
+	if (counter->batch_inflight == 0) {
+		// Every chunk in this shard's key range has completed.
+		loop_complete(counter);
+	}
+}
+
+static void
+loop_complete(counter* counter)
+{
+	// Running in this shard's event loop thread.
+	if (counter->state == LOOP_CLOSED) {
+		return;
+	}
+
+	if (counter->state == LOOP_DRAINING) {
+		counter->drain_time = histogram_now() - counter->drain_begin;
+	}
+	counter->state = LOOP_CLOSED;
+	loop_stats_stop(&counter->stats);
+	stop_throttle(counter);
+	stop_reporter(counter->event_loop);
+
+	if (counter->stall_active) {
+		counter->stall_active = false;
+		loop_timer_close(&counter->stall_timer);
+	}
+
+	retry_queue_close(&counter->retry);
+
+	// Only the last event loop to complete combines the counter shards.
+	if (as_aaf_uint32(&g_loops_remaining, -1) != 0) {
+		return;
+	}
+
+	if (g_export_path) {
+		export_complete();
+		return;
+	}
+
+	uint64_t written = 0;
+	uint64_t errors = 0;
+	uint64_t reads = 0;
+	uint64_t read_errors = 0;
+	uint32_t found = 0;
+	uint32_t total = 0;
+	uint32_t chunks = 0;
+	histogram* write_latency = malloc(sizeof(histogram));
+	histogram* read_latency = malloc(sizeof(histogram));
+	histogram* batch_latency = malloc(sizeof(histogram));
+
+	histogram_init(write_latency);
+	histogram_init(read_latency);
+	histogram_init(batch_latency);
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		counter = g_counters[i];
+		written += counter->count;
+		errors += counter->errors;
+		reads += counter->reads;
+		read_errors += counter->read_errors;
+		found += counter->found;
+		chunks += counter->batch_chunks;
+		total += counter->max - counter->begin;
+		histogram_merge(write_latency, &counter->write_latency);
+		histogram_merge(read_latency, &counter->read_latency);
+		histogram_merge(batch_latency, &counter->batch_latency);
+	}
+
+	if (g_benchmark && g_warmup > 0) {
+		// Throughput below only counts writes completed after warmup.
+		printf("Wrote %llu records, %llu after warmup\n", (unsigned long long)written,
+			(unsigned long long)write_latency->count);
 	}
 	else {
-		if (counter->pipe_listener) {
-			// There's one fewer command in the pipeline.
-			counter->pipe_count--;
+		printf("Wrote %llu records\n", (unsigned long long)written);
+	}
+
+	if (g_mixed) {
+		printf("Read %llu records\n", (unsigned long long)reads);
+	}
+
+	if (g_benchmark) {
+		// A run that was shut down early only measured until shutdown.
+		uint64_t end = g_shutdown && g_shutdown_time < g_end ? g_shutdown_time : g_end;
+		double seconds = (end > g_warmup_end ? end - g_warmup_end : 1) / 1000000000.0;
+		printf("Write throughput: %.0f ops/sec, %llu errors\n",
+			write_latency->count / seconds, (unsigned long long)errors);
+
+		if (g_mixed) {
+			printf("Read throughput: %.0f ops/sec, %llu errors\n",
+				read_latency->count / seconds, (unsigned long long)read_errors);
+		}
+	}
+	if (g_load_path) {
+		// Ingest rate from first loop start until the last loop finished.
+		uint64_t begin = UINT64_MAX;
+		uint64_t malformed = 0;
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			if (g_counters[i]->stats.start_time < begin) {
+				begin = g_counters[i]->stats.start_time;
+			}
+			malformed += g_counters[i]->malformed;
+		}
+
+		double seconds = (histogram_now() - begin) / 1000000000.0;
+		printf("Loaded %llu records, %llu errors, %llu malformed in %.3fs: %.0f records/sec, %.1f MB/sec\n",
+			(unsigned long long)written, (unsigned long long)errors, (unsigned long long)malformed,
+			seconds, written / seconds, g_load.size / 1000000.0 / seconds);
+	}
+	else {
+		printf("Found %u/%u records in %u batch chunks\n", found, total, chunks);
+	}
+
+	if (g_benchmark) {
+		// Whole process, including warmup, batch reads and client threads.
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+
+		double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+			usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+		uint64_t ops = written + reads;
+
+		printf("Process cpu: %.3fs, %.2f us/op, max rss: %ld KB\n",
+			cpu, ops ? cpu * 1000000.0 / ops : 0, (long)usage.ru_maxrss);
+	}
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		loop_stats_print(i, &g_counters[i]->stats, NULL, counter_events(g_counters[i]));
+	}
+
+	if (g_benchmark || g_shutdown) {
+		// Drain is the time from when a loop stopped issuing until its last
+		// command was back.
+		uint64_t drain_max = 0;
+		uint32_t drained = 0;
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			counter = g_counters[i];
+			printf("Loop %u drain: %.3fms\n", i, counter->drain_time / 1000000.0);
+
+			if (counter->drain_time > drain_max) {
+				drain_max = counter->drain_time;
+			}
+			drained += counter->drain_inflight;
+		}
+
+		if (g_shutdown) {
+			printf("Shutdown (%s): %u commands in flight drained in %.3fms\n",
+				g_shutdown_reason, drained, drain_max / 1000000.0);
+		}
+	}
+
+	if (g_routes.node_count > 0) {
+		// Commands per loop and per node. A loop only opens connections to the
+		// nodes it sends to, so fewer nodes per loop means fewer connections.
+		uint32_t node_count = g_routes.node_count;
+		uint64_t* node_total = calloc(node_count + 1, sizeof(uint64_t));
+		uint32_t* node_loops = calloc(node_count + 1, sizeof(uint32_t));
+		uint64_t sent = 0;
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			for (uint32_t n = 0; n <= node_count; n++) {
+				uint64_t commands = g_counters[i]->node_commands[n];
+
+				node_total[n] += commands;
+				node_loops[n] += commands > 0;
+				sent += commands;
+			}
+		}
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			uint64_t commands = 0;
+			uint32_t nodes = 0;
+
+			for (uint32_t n = 0; n <= node_count; n++) {
+				commands += g_counters[i]->node_commands[n];
+				nodes += n < node_count && g_counters[i]->node_commands[n] > 0;
+			}
+			printf("Loop %u route: %llu commands (%.1f%%) to %u/%u nodes\n",
+				i, (unsigned long long)commands, sent ? commands * 100.0 / sent : 0, nodes, node_count);
+		}
+
+		for (uint32_t n = 0; n <= node_count; n++) {
+			if (n == node_count && node_total[n] == 0) {
+				break;
+			}
+			printf("Node %s route: %llu commands (%.1f%%) from %u/%u loops\n",
+				n < node_count ? g_routes.node_names[n] : "unknown", (unsigned long long)node_total[n],
+				sent ? node_total[n] * 100.0 / sent : 0, node_loops[n], g_loop_count);
+		}
+		free(node_total);
+		free(node_loops);
+	}
+
+	if (g_pipeline) {
+		uint64_t ramp_max = 0;
+		double depth_total = 0;
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			counter = g_counters[i];
+			double depth = counter->depth_samples ? (double)counter->depth_sum / counter->depth_samples : 0;
+			printf("Loop %u pipeline: ramp-up=%.3fms depth=%.1f\n",
+				i, counter->ramp_time / 1000000.0, depth);
+
+			if (counter->ramp_time > ramp_max) {
+				ramp_max = counter->ramp_time;
+			}
+			depth_total += depth;
+		}
+		printf("Pipeline ramp-up: %.3fms, steady-state depth: %.1f across all loops\n",
+			ramp_max / 1000000.0, depth_total);
+	}
+
+	if (g_throttle > 0 && ! g_benchmark) {
+		// Rate over the write phase, from first loop start to last loop
+		// running out of writes.
+		uint64_t begin = UINT64_MAX;
+		uint64_t end = 0;
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			counter = g_counters[i];
+
+			if (counter->stats.start_time < begin) {
+				begin = counter->stats.start_time;
+			}
+
+			if (counter->throttle_end > end) {
+				end = counter->throttle_end;
+			}
+		}
+
+		if (end > begin) {
+			printf("Throttle: target %.0f ops/sec, achieved %.0f ops/sec\n",
+				g_throttle, (written + reads) / ((end - begin) / 1000000000.0));
+		}
+	}
+
+	if (g_rate > 0) {
+		uint64_t lag_max = 0;
+		uint64_t missed = 0;
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			counter = g_counters[i];
+			missed += counter->missed;
+
+			if (counter->lag_max > lag_max) {
+				lag_max = counter->lag_max;
+			}
+		}
+		printf("Open loop: target %.0f ops/sec, max lag behind schedule %.3fms, %llu commands never sent\n",
+			g_rate, lag_max / 1000000.0, (unsigned long long)missed);
+	}
+
+	if (g_submit_threads > 0) {
+		uint64_t submitted = 0;
+		uint64_t wakeups = 0;
+		histogram* submit_latency = malloc(sizeof(histogram));
+
+		histogram_init(submit_latency);
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			counter = g_counters[i];
+			submitted += counter->submitted;
+			wakeups += counter->wakeups;
+			histogram_merge(submit_latency, &counter->submit_latency);
+		}
+		printf("Submit: %u producers, %llu commands, %llu wakeups (%.1f commands per wakeup), %llu ring full\n",
+			g_submit_threads, (unsigned long long)submitted, (unsigned long long)wakeups,
+			wakeups ? (double)submitted / wakeups : 0, (unsigned long long)as_load_uint64(&g_submit_full));
+		histogram_print(submit_latency, "Submit enqueue-to-issue");
+		free(submit_latency);
+	}
+
+	if (g_adaptive) {
+		uint32_t window_total = 0;
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			window* w = &g_counters[i]->window;
+			printf("Loop %u window: final=%u average=%.0f rounds=%llu\n",
+				i, w->size, w->avg_size, (unsigned long long)w->rounds);
+			window_total += w->size;
 		}
+		printf("Adaptive window: %u commands inflight across all loops\n", window_total);
+	}
+	if (g_max_retries > 0) {
+		uint64_t retries = 0;
+		uint64_t exhausted = 0;
+		uint64_t batch_errors = 0;
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			counter = g_counters[i];
+			retries += counter->retries;
+			exhausted += counter->exhausted;
+			batch_errors += counter->batch_errors;
+		}
+		printf("Retries: %llu sent, %llu errors out of retries, %llu not retryable, %llu batch chunks failed\n",
+			(unsigned long long)retries, (unsigned long long)exhausted,
+			(unsigned long long)(errors + read_errors + batch_errors - exhausted), (unsigned long long)batch_errors);
+	}
+
+	if (g_hedge) {
+		uint64_t hedges = 0;
+		uint64_t wins = 0;
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			counter = g_counters[i];
+			hedges += counter->hedges;
+			wins += counter->hedge_wins;
+			printf("Loop %u hedge delay: %.0fus\n", i, counter->hedge_delay / 1000.0);
+		}
+		printf("Hedged reads: %llu sent (%.2f%% of reads), %llu answered first\n",
+			(unsigned long long)hedges, reads ? hedges * 100.0 / reads : 0, (unsigned long long)wins);
+	}
+	histogram_print(write_latency, g_pipeline ? "Pipeline write" : g_coro ? "Coroutine write" : "Async write");
+
+	if (g_mixed) {
+		histogram_print(read_latency, g_pipeline ? "Pipeline read" : g_coro ? "Coroutine read" : "Async read");
+	}
+	if (! g_load_path) {
+		histogram_print(batch_latency, "Batch read");
 	}
+	free(write_latency);
+	free(read_latency);
+	free(batch_latency);
+	notify_complete();
+}
+
+static uint64_t
+counter_events(counter* counter)
+{
+	// Completions handled by this shard's event loop.
+	return as_load_uint64(&counter->count) + as_load_uint64(&counter->errors) +
+		as_load_uint64(&counter->reads) + as_load_uint64(&counter->read_errors) +
+		as_load_uint32(&counter->batch_chunks);
 }
 
 static void
-batch_read(as_event_loop* event_loop, uint32_t max_records)
+export_flushed_loop(void* udata)
 {
-	// Make a batch of all the keys we inserted.
-	as_batch_read_records* records = as_batch_read_create(max_records);
-	
-	for (uint32_t i = 0; i < max_records; i++) {
-		as_batch_read_record* record = as_batch_read_reserve(records);
-		as_key_init_int64(&record->key, g_namespace, g_set, (int64_t)i);
-		record->read_all_bins = true;
+	// Back on the shard's event loop.
+	counter* counter = udata;
+	export_writer* w = &counter->writer;
+
+	export_writer_done(w);
+
+	if (w->failed && ! counter->export_done) {
+		// The file can not be completed. Stop every loop's scan instead of
+		// reading the rest of the set into buffers that are thrown away.
+		shutdown_begin("export write failed");
+
+		// A page still being read ends in export_listener(), which stops at
+		// the page boundary. Draining now would close the loop under it.
+		if (! counter->page_inflight) {
+			export_resume(counter);
+		}
 	}
-	
-	// Read these keys.
-	as_error err;
-	if (aerospike_batch_read_async(&as, &err, NULL, records, batch_listener, NULL, event_loop) != AEROSPIKE_OK) {
-		batch_listener(&err, records, NULL, event_loop);
+	else if (counter->export_done) {
+		export_drain(counter);
+	}
+	else if (counter->export_paused) {
+		export_resume(counter);
+	}
+	else if (export_writer_full(w)) {
+		// Active buffer filled up while the other one was being written.
+		export_writer_flush(w);
 	}
 }
 
 static void
-batch_listener(as_error* err, as_batch_read_records* records, void* udata, as_event_loop* event_loop)
+export_flushed(void* udata)
+{
+	// Running in the writer thread. Hand the event back to the loop that owns
+	// the shard.
+	counter* counter = udata;
+	as_event_execute(counter->event_loop, export_flushed_loop, counter);
+}
+
+static void
+start_export(counter* counter)
+{
+	uint32_t i = counter->event_loop->index;
+	uint32_t begin = PARTITION_COUNT * i / g_loop_count;
+	uint32_t end = PARTITION_COUNT * (i + 1) / g_loop_count;
+
+	// Writer thread is started from this loop's thread, so it inherits the
+	// loop's cpu and its buffers stay on the same NUMA node.
+	as_scan_init(&counter->scan, g_namespace, g_set);
+	as_scan_set_paginate(&counter->scan, true);
+
+	if (! export_writer_init(&counter->writer, &g_export, EXPORT_BUFFER_SIZE, export_flushed, counter)) {
+		printf("Failed to start export writer\n");
+		shutdown_begin("export writer failed");
+		loop_complete(counter);
+		return;
+	}
+
+	if (begin == end || as_load_uint32(&g_shutdown)) {
+		// More event loops than partitions, or shutdown began before this
+		// loop started.
+		counter->export_done = true;
+		export_drain(counter);
+		return;
+	}
+
+	// Each loop scans its own range of partitions, one page at a time.
+	as_partition_filter_set_range(&counter->partitions, begin, end - begin);
+	export_page(counter);
+}
+
+static void
+export_page(counter* counter)
+{
+	as_policy_scan policy;
+	as_policy_scan_init(&policy);
+	policy.max_records = EXPORT_PAGE_RECORDS;
+
+	// A paginated scan resumes each partition where the previous page ended.
+	as_error err;
+	counter->page_inflight = true;
+
+	if (aerospike_scan_partitions_async(&as, &err, &policy, &counter->scan, &counter->partitions,
+		export_listener, counter, counter->event_loop) != AEROSPIKE_OK) {
+		export_listener(&err, NULL, counter, counter->event_loop);
+	}
+}
+
+static bool
+export_listener(as_error* err, as_record* record, void* udata, as_event_loop* event_loop)
 {
+	counter* counter = udata;
+	export_writer* w = &counter->writer;
+
 	if (err) {
-		printf("aerospike_batch_read_async() returned %d - %s\n", err->code, err->message);
-		as_batch_read_destroy(records);
-		as_monitor_notify(&app_complete_monitor);
+		printf("aerospike_scan_partitions_async() returned %d - %s\n", err->code, err->message);
+		counter->page_inflight = false;
+		counter->errors++;
+		counter->error_codes[stats_code_slot(err->code)]++;
+		counter->export_done = true;
+
+		// This loop's partitions are missing from the file, so stop the other
+		// loops too.
+		shutdown_begin("export scan error");
+		export_drain(counter);
+		return false;
+	}
+
+	if (record) {
+		export_writer_append(w, record);
+		counter->count++;
+
+		if (export_writer_full(w)) {
+			// Start writing as soon as a buffer fills. If the other buffer is
+			// still being written, this one keeps growing until the page ends.
+			export_writer_flush(w);
+		}
+		return true;
+	}
+
+	// Page has ended.
+	counter->page_inflight = false;
+	counter->pages++;
+
+	if (as_scan_is_done(&counter->scan)) {
+		counter->export_done = true;
+		export_drain(counter);
+		return true;
+	}
+	export_resume(counter);
+	return true;
+}
+
+static void
+export_resume(counter* counter)
+{
+	export_writer* w = &counter->writer;
+
+	if (as_load_uint32(&g_shutdown) || w->failed) {
+		// Stop between pages. What was scanned is still written.
+		counter->export_done = true;
+		export_drain(counter);
 		return;
 	}
 
-	as_vector* list = &records->list;
+	if (export_writer_full(w) && ! export_writer_flush(w)) {
+		// Both buffers are full. Leave this loop's partitions paused until
+		// the writer thread frees a buffer, so memory stays flat however
+		// large the set is.
+		if (! counter->export_paused) {
+			counter->export_paused = true;
+			counter->stalls++;
+		}
+		return;
+	}
+	counter->export_paused = false;
+	export_page(counter);
+}
 
-	uint32_t n_found = 0;
+static void
+export_drain(counter* counter)
+{
+	export_writer* w = &counter->writer;
 
-	for (uint32_t i = 0; i < list->size; i++) {
-		as_batch_read_record* record = as_vector_get(list, i);
+	// Scan has ended. Write what is left, one buffer at a time.
+	if (w->pending || export_writer_flush(w)) {
+		return;
+	}
+	loop_complete(counter);
+}
 
-		if (record->result == AEROSPIKE_OK) {
-			n_found++;
+static void
+export_complete(void)
+{
+	// Export rate from first loop start until the last loop finished.
+	uint64_t begin = UINT64_MAX;
+	uint64_t records = 0;
+	uint64_t errors = 0;
+	uint64_t bytes = 0;
+	uint64_t pages = 0;
+	uint64_t stalls = 0;
+	uint64_t drain_max = 0;
+	bool failed = false;
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		counter* counter = g_counters[i];
+
+		if (counter->stats.start_time < begin) {
+			begin = counter->stats.start_time;
 		}
-		else if (record->result == AEROSPIKE_ERR_RECORD_NOT_FOUND) {
-			// The transaction succeeded but the record doesn't exist.
-			printf("AEROSPIKE_ERR_RECORD_NOT_FOUND\n");
+		records += counter->count;
+		errors += counter->errors;
+		bytes += counter->writer.bytes;
+		pages += counter->pages;
+		stalls += counter->stalls;
+		failed = failed || counter->writer.failed;
+
+		if (counter->drain_time > drain_max) {
+			drain_max = counter->drain_time;
 		}
-		else {
-			// The transaction failed.
-			printf("Error %d\n", record->result);
+	}
+
+	double seconds = (histogram_now() - begin) / 1000000000.0;
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("Exported %llu records, %.1f MB, %llu errors in %.3fs: %.0f records/sec, %.1f MB/sec\n",
+		(unsigned long long)records, bytes / 1000000.0, (unsigned long long)errors,
+		seconds, records / seconds, bytes / 1000000.0 / seconds);
+	printf("Export scan: %llu pages, paused %llu times for the writer, max rss: %ld KB\n",
+		(unsigned long long)pages, (unsigned long long)stalls, (long)usage.ru_maxrss);
+
+	if (g_shutdown) {
+		// Scans stopped at a page boundary, and their records were still written.
+		printf("Shutdown (%s): export drained in %.3fms\n", g_shutdown_reason, drain_max / 1000000.0);
+	}
+
+	if (failed || errors > 0 || g_shutdown) {
+		printf("Export file is incomplete\n");
+	}
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		loop_stats_print(i, &g_counters[i]->stats, NULL, counter_events(g_counters[i]));
+	}
+	notify_complete();
+}
+
+static void
+start_reporter(as_event_loop* event_loop)
+{
+	reporter* r = &g_reporter;
+
+	r->event_loop = event_loop;
+	r->last_time = histogram_now();
+	r->last_count = 0;
+	r->last_reads = 0;
+	r->last_errors = 0;
+	r->last_stats = calloc(g_loop_count, sizeof(loop_stats));
+	r->last_events = calloc(g_loop_count, sizeof(uint64_t));
+	r->active = true;
+	loop_timer_init(&r->timer, event_loop, report, r);
+	loop_timer_start(&r->timer, g_interval / 1000, g_interval / 1000);
+}
+
+static void
+stop_reporter(as_event_loop* event_loop)
+{
+	reporter* r = &g_reporter;
+
+	// Reporter must be closed from its own event loop.
+	if (r->event_loop == event_loop && r->active) {
+		r->active = false;
+		loop_timer_close(&r->timer);
+		free(r->last_stats);
+		free(r->last_events);
+	}
+}
+
+static void
+report(void* udata)
+{
+	reporter* r = udata;
+	uint64_t now = histogram_now();
+	uint64_t count = 0;
+	uint64_t errors = 0;
+	uint64_t reads = 0;
+	uint32_t inflight = 0;
+	uint32_t queue_size = 0;
+	uint32_t found = 0;
+	uint32_t chunks = 0;
+	uint64_t backlog = 0;
+
+	// Other event loops own these shards. Aligned loads of their counters do
+	// not tear, and a value that is one command stale is fine for reporting.
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		counter* counter = as_load_ptr(&g_counters[i]);
+
+		if (counter) {
+			count += as_load_uint64(&counter->count);
+			errors += as_load_uint64(&counter->errors) + as_load_uint64(&counter->read_errors);
+			reads += as_load_uint64(&counter->reads);
+			inflight += as_load_uint32(&counter->inflight);
+			queue_size += as_load_uint32(&counter->queue_size);
+			found += as_load_uint32(&counter->found);
+			chunks += as_load_uint32(&counter->batch_chunks);
+			backlog += as_load_uint64(&counter->backlog);
+		}
+	}
+
+	double seconds = (now - r->last_time) / 1000000000.0;
+
+	if (now >= g_end) {
+		// Writes are over. Report batch read progress while draining.
+		printf("[read] chunks=%u found=%u\n", chunks, found);
+		r->last_time = now;
+		return;
+	}
+
+	printf("%s writes/sec=%.0f reads/sec=%.0f errors=%llu inflight=%u window=%u",
+		now < g_warmup_end ? "[warmup]" : "[measure]",
+		(count - r->last_count) / seconds, (reads - r->last_reads) / seconds,
+		(unsigned long long)(errors - r->last_errors), inflight, queue_size);
+
+	if (g_rate > 0) {
+		printf(" backlog=%llu", (unsigned long long)backlog);
+	}
+	printf("\n");
+
+	// Per loop breakdown shows whether loops are cpu bound (add loops) or
+	// mostly waiting on I/O (add connections or inflight commands).
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		counter* counter = as_load_ptr(&g_counters[i]);
+
+		if (counter) {
+			loop_stats cur;
+			loop_stats* last = &r->last_stats[i];
+			uint64_t events = counter_events(counter);
+
+			loop_stats_snapshot(&cur, &counter->stats);
+			loop_stats_print(i, &cur, last->sample_time ? last : NULL, events - r->last_events[i]);
+			*last = cur;
+			r->last_events[i] = events;
+		}
+	}
+
+	r->last_time = now;
+	r->last_count = count;
+	r->last_reads = reads;
+	r->last_errors = errors;
+}
+
+static void
+write_stats(FILE* out, void* udata)
+{
+	// Stats server thread. Shards are read the same way report() reads them:
+	// aligned loads that never tear, and may be a command or two stale.
+	const char* write_op = g_export_path ? "scan" : "write";
+	char labels[96];
+
+	for (uint32_t m = 0; m < sizeof(g_loop_metrics) / sizeof(g_loop_metrics[0]); m++) {
+		const loop_metric* metric = &g_loop_metrics[m];
+
+		stats_family(out, metric->name, "counter", metric->help);
+
+		for (uint32_t i = 0; i < g_loop_count; i++) {
+			counter* counter = as_load_ptr(&g_counters[i]);
+
+			if (counter) {
+				snprintf(labels, sizeof(labels), "loop=\"%u\"", i);
+				stats_sample(out, metric->name, labels, as_load_uint64((uint64_t*)((char*)counter + metric->offset)));
+			}
+		}
+	}
+
+	stats_family(out, "async_tutorial_completed_total", "counter", "Commands and batch chunks completed.");
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		counter* counter = as_load_ptr(&g_counters[i]);
+
+		if (! counter) {
+			continue;
+		}
+
+		struct {
+			const char* op;
+			uint64_t ok;
+			uint64_t error;
+		} ops[] = {
+			{write_op, as_load_uint64(&counter->count), as_load_uint64(&counter->errors)},
+			{"read", as_load_uint64(&counter->reads), as_load_uint64(&counter->read_errors)},
+			{"batch", as_load_uint32(&counter->batch_chunks), as_load_uint64(&counter->batch_errors)}
+		};
+
+		for (uint32_t j = 0; j < sizeof(ops) / sizeof(ops[0]); j++) {
+			snprintf(labels, sizeof(labels), "loop=\"%u\",op=\"%s\",result=\"ok\"", i, ops[j].op);
+			stats_sample(out, "async_tutorial_completed_total", labels, ops[j].ok);
+			snprintf(labels, sizeof(labels), "loop=\"%u\",op=\"%s\",result=\"error\"", i, ops[j].op);
+			stats_sample(out, "async_tutorial_completed_total", labels, ops[j].error);
+		}
+	}
+
+	stats_family(out, "async_tutorial_errors_total", "counter", "Errors by status code. Not found reads are not errors.");
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		counter* counter = as_load_ptr(&g_counters[i]);
+
+		if (! counter) {
+			continue;
+		}
+
+		for (uint32_t slot = 0; slot < STATS_CODES; slot++) {
+			uint64_t errors = as_load_uint64(&counter->error_codes[slot]);
+			int code;
+
+			if (errors == 0) {
+				continue;
+			}
+
+			if (stats_slot_code(slot, &code)) {
+				snprintf(labels, sizeof(labels), "loop=\"%u\",code=\"%d\"", i, code);
+			}
+			else {
+				snprintf(labels, sizeof(labels), "loop=\"%u\",code=\"other\"", i);
+			}
+			stats_sample(out, "async_tutorial_errors_total", labels, errors);
 		}
 	}
 
-	printf("Found %u/%u records\n", n_found, list->size);
-	as_batch_read_destroy(records);
-	as_monitor_notify(&app_complete_monitor);
+	stats_family(out, "async_tutorial_inflight", "gauge", "Commands and batch chunks issued but not completed.");
+
+	for (uint32_t i = 0; i < g_loop_count; i++) {
+		counter* counter = as_load_ptr(&g_counters[i]);
+
+		if (counter) {
+			snprintf(labels, sizeof(labels), "loop=\"%u\",op=\"command\"", i);
+			stats_sample(out, "async_tutorial_inflight", labels, as_load_uint32(&counter->inflight));
+			snprintf(labels, sizeof(labels), "loop=\"%u\",op=\"batch\"", i);
+			stats_sample(out, "async_tutorial_inflight", labels, as_load_uint32(&counter->batch_inflight));
+		}
+	}
 }
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <aerospike/aerospike.h>
+#include <aerospike/as_event.h>
+#include <stdbool.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+typedef void (*backend_hook)(void* udata);
+
+// Event library that external loops are created with. Exactly one backend is
+// linked into each program, matching the event library the client was built
+// with, so workload code never needs to know which one it is running on.
+typedef struct {
+	const char* name;
+
+	// Create a native loop in the calling thread. Single thread programs
+	// run one loop on the main thread and expect run() to return once the
+	// client has closed; shared loops keep running until stopped.
+	void* (*create)(bool single_thread);
+
+	// Run loop until it has no more work or is stopped.
+	void (*run)(void* native);
+
+	// Break out of run() from another thread after the client has closed
+	// its event loops. NULL if run() already returns by itself.
+	void (*stop)(void* native);
+
+	// Close any remaining handles and free loop. Called in the loop thread
+	// after run() returns.
+	void (*destroy)(void* native);
+
+	// Register client with a single thread loop.
+	void (*register_aerospike)(as_event_loop* event_loop, aerospike* as);
+
+	// Close and destroy client from within a single thread loop.
+	void (*close_aerospike)(as_event_loop* event_loop, aerospike* as);
+
+	// Call prepare just before the loop blocks waiting for I/O and check
+	// just after it wakes up. Hooks do not keep the loop alive. Returns a
+	// handle for remove_hooks(), or NULL if the event library has no such
+	// hooks. Called in the loop thread.
+	void* (*add_hooks)(void* native, backend_hook prepare, backend_hook check, void* udata);
+
+	// Stop and free hooks. Called in the loop thread.
+	void (*remove_hooks)(void* hooks);
+
+	// Call callback in the loop thread after notify(). Notifies from other
+	// threads before the callback runs are coalesced into one call. The
+	// notifier does not keep the loop alive. Returns a handle for notify()
+	// and remove_notifier(). Called in the loop thread.
+	void* (*add_notifier)(void* native, backend_hook callback, void* udata);
+
+	// Wake loop. Safe to call from any thread.
+	void (*notify)(void* notifier);
+
+	// Stop and free notifier. No notify() may follow. Called in the loop thread.
+	void (*remove_notifier)(void* notifier);
+} backend;
+
+/******************************************************************************
+ *	Globals
+ *****************************************************************************/
+
+extern const backend g_backend;
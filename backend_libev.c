@@ -0,0 +1,166 @@
+#include "backend.h"
+#include <stdlib.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+typedef struct {
+	ev_prepare prepare;
+	ev_check check;
+	struct ev_loop* loop;
+	backend_hook prepare_hook;
+	backend_hook check_hook;
+	void* udata;
+} libev_hooks;
+
+typedef struct {
+	ev_async async;
+	struct ev_loop* loop;
+	backend_hook callback;
+	void* udata;
+} libev_notifier;
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static void*
+libev_create(bool single_thread)
+{
+	return ev_loop_new(EVFLAG_AUTO);
+}
+
+static void
+libev_run(void* native)
+{
+	ev_loop(native, 0);
+}
+
+static void
+libev_destroy(void* native)
+{
+	ev_loop_destroy(native);
+}
+
+static void
+libev_register_aerospike(as_event_loop* event_loop, aerospike* as)
+{
+}
+
+static void
+libev_close_aerospike(as_event_loop* event_loop, aerospike* as)
+{
+	as_error err;
+	aerospike_close(as, &err);
+	aerospike_destroy(as);
+	as_event_close_loops();
+}
+
+static void
+libev_prepare(struct ev_loop* loop, ev_prepare* watcher, int revents)
+{
+	libev_hooks* hooks = watcher->data;
+	hooks->prepare_hook(hooks->udata);
+}
+
+static void
+libev_check(struct ev_loop* loop, ev_check* watcher, int revents)
+{
+	libev_hooks* hooks = watcher->data;
+	hooks->check_hook(hooks->udata);
+}
+
+static void*
+libev_add_hooks(void* native, backend_hook prepare, backend_hook check, void* udata)
+{
+	libev_hooks* hooks = malloc(sizeof(libev_hooks));
+	hooks->loop = native;
+	hooks->prepare_hook = prepare;
+	hooks->check_hook = check;
+	hooks->udata = udata;
+
+	ev_prepare_init(&hooks->prepare, libev_prepare);
+	hooks->prepare.data = hooks;
+	ev_prepare_start(hooks->loop, &hooks->prepare);
+
+	ev_check_init(&hooks->check, libev_check);
+	hooks->check.data = hooks;
+	ev_check_start(hooks->loop, &hooks->check);
+
+	// Active watchers keep ev_loop() running, so release their references.
+	ev_unref(hooks->loop);
+	ev_unref(hooks->loop);
+	return hooks;
+}
+
+static void
+libev_remove_hooks(void* udata)
+{
+	libev_hooks* hooks = udata;
+
+	// Restore references before stopping watchers.
+	ev_ref(hooks->loop);
+	ev_prepare_stop(hooks->loop, &hooks->prepare);
+	ev_ref(hooks->loop);
+	ev_check_stop(hooks->loop, &hooks->check);
+	free(hooks);
+}
+
+static void
+libev_notified(struct ev_loop* loop, ev_async* watcher, int revents)
+{
+	libev_notifier* notifier = watcher->data;
+	notifier->callback(notifier->udata);
+}
+
+static void*
+libev_add_notifier(void* native, backend_hook callback, void* udata)
+{
+	libev_notifier* notifier = malloc(sizeof(libev_notifier));
+	notifier->loop = native;
+	notifier->callback = callback;
+	notifier->udata = udata;
+
+	ev_async_init(&notifier->async, libev_notified);
+	notifier->async.data = notifier;
+	ev_async_start(notifier->loop, &notifier->async);
+	ev_unref(notifier->loop);
+	return notifier;
+}
+
+static void
+libev_notify(void* udata)
+{
+	libev_notifier* notifier = udata;
+	ev_async_send(notifier->loop, &notifier->async);
+}
+
+static void
+libev_remove_notifier(void* udata)
+{
+	libev_notifier* notifier = udata;
+
+	ev_ref(notifier->loop);
+	ev_async_stop(notifier->loop, &notifier->async);
+	free(notifier);
+}
+
+/******************************************************************************
+ *	Backend
+ *****************************************************************************/
+
+const backend g_backend = {
+	.name = "libev",
+	.create = libev_create,
+	.run = libev_run,
+	.stop = NULL,
+	.destroy = libev_destroy,
+	.register_aerospike = libev_register_aerospike,
+	.close_aerospike = libev_close_aerospike,
+	.add_hooks = libev_add_hooks,
+	.remove_hooks = libev_remove_hooks,
+	.add_notifier = libev_add_notifier,
+	.notify = libev_notify,
+	.remove_notifier = libev_remove_notifier
+};
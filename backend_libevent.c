@@ -0,0 +1,229 @@
+#include "backend.h"
+#include <event.h>
+#include <stdlib.h>
+
+#if LIBEVENT_VERSION_NUMBER < 0x02010000
+void event_base_add_virtual(struct event_base*);
+#endif
+
+// Prepare/check watchers were added in libevent 2.2.
+#if LIBEVENT_VERSION_NUMBER >= 0x02020000
+#include <event2/watch.h>
+#define LIBEVENT_HAS_WATCH
+#endif
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+#if defined(LIBEVENT_HAS_WATCH)
+typedef struct {
+	struct evwatch* prepare;
+	struct evwatch* check;
+	backend_hook prepare_hook;
+	backend_hook check_hook;
+	void* udata;
+} libevent_hooks;
+#endif
+
+typedef struct {
+	struct event* event;
+	backend_hook callback;
+	void* udata;
+} libevent_notifier;
+
+/******************************************************************************
+ *	Globals
+ *****************************************************************************/
+
+// Every loop in a program runs in the same mode.
+static bool g_single_thread;
+
+// Client being closed by close_aerospike().
+static aerospike* g_closing;
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static void*
+libevent_create(bool single_thread)
+{
+	g_single_thread = single_thread;
+
+	if (single_thread) {
+		// Tell client to not call evthread_use_pthreads().
+		as_event_set_single_thread(true);
+		return event_base_new();
+	}
+
+	struct event_base* loop = event_base_new();
+
+	// Add a virtual event to prevent event_base_dispatch() from returning prematurely.
+#if LIBEVENT_VERSION_NUMBER < 0x02010000
+	event_base_add_virtual(loop);
+#endif
+	return loop;
+}
+
+static void
+libevent_run(void* native)
+{
+	if (g_single_thread) {
+		event_base_dispatch(native);
+		return;
+	}
+
+#if LIBEVENT_VERSION_NUMBER < 0x02010000
+	event_base_dispatch(native);
+#else
+	event_base_loop(native, EVLOOP_NO_EXIT_ON_EMPTY);
+#endif
+}
+
+static void
+libevent_stop(void* native)
+{
+	event_base_loopbreak(native);
+}
+
+static void
+libevent_destroy(void* native)
+{
+	event_base_free(native);
+}
+
+static void
+libevent_register_aerospike(as_event_loop* event_loop, aerospike* as)
+{
+	as_event_loop_register_aerospike(event_loop, as);
+}
+
+static void
+destroy_aerospike(void* udata)
+{
+	as_event_loop* event_loop = udata;
+
+	as_error err;
+	aerospike_close(g_closing, &err);
+	aerospike_destroy(g_closing);
+	as_event_close_loop(event_loop);
+}
+
+static void
+libevent_close_aerospike(as_event_loop* event_loop, aerospike* as)
+{
+	// Client must wait for loop to finish its commands before closing.
+	g_closing = as;
+	as_event_loop_close_aerospike(event_loop, as, destroy_aerospike, event_loop);
+}
+
+#if defined(LIBEVENT_HAS_WATCH)
+
+static void
+libevent_prepare(struct evwatch* watcher, const struct evwatch_prepare_cb_info* info, void* udata)
+{
+	libevent_hooks* hooks = udata;
+	hooks->prepare_hook(hooks->udata);
+}
+
+static void
+libevent_check(struct evwatch* watcher, const struct evwatch_check_cb_info* info, void* udata)
+{
+	libevent_hooks* hooks = udata;
+	hooks->check_hook(hooks->udata);
+}
+
+static void*
+libevent_add_hooks(void* native, backend_hook prepare, backend_hook check, void* udata)
+{
+	libevent_hooks* hooks = malloc(sizeof(libevent_hooks));
+	hooks->prepare_hook = prepare;
+	hooks->check_hook = check;
+	hooks->udata = udata;
+	hooks->prepare = evwatch_prepare_new(native, libevent_prepare, hooks);
+	hooks->check = evwatch_check_new(native, libevent_check, hooks);
+	return hooks;
+}
+
+static void
+libevent_remove_hooks(void* udata)
+{
+	libevent_hooks* hooks = udata;
+
+	evwatch_free(hooks->prepare);
+	evwatch_free(hooks->check);
+	free(hooks);
+}
+
+#else
+
+static void*
+libevent_add_hooks(void* native, backend_hook prepare, backend_hook check, void* udata)
+{
+	return NULL;
+}
+
+static void
+libevent_remove_hooks(void* hooks)
+{
+}
+
+#endif
+
+static void
+libevent_notified(evutil_socket_t fd, short events, void* udata)
+{
+	libevent_notifier* notifier = udata;
+	notifier->callback(notifier->udata);
+}
+
+static void*
+libevent_add_notifier(void* native, backend_hook callback, void* udata)
+{
+	libevent_notifier* notifier = malloc(sizeof(libevent_notifier));
+	notifier->callback = callback;
+	notifier->udata = udata;
+
+	// Never added, so it does not keep the loop alive. Activating an event
+	// that is already active does nothing, which coalesces notifies.
+	notifier->event = event_new(native, -1, 0, libevent_notified, notifier);
+	return notifier;
+}
+
+static void
+libevent_notify(void* udata)
+{
+	// Cross-thread activation relies on the locking the client enables with
+	// evthread_use_pthreads() for multi-thread loops.
+	libevent_notifier* notifier = udata;
+	event_active(notifier->event, 0, 0);
+}
+
+static void
+libevent_remove_notifier(void* udata)
+{
+	libevent_notifier* notifier = udata;
+
+	event_free(notifier->event);
+	free(notifier);
+}
+
+/******************************************************************************
+ *	Backend
+ *****************************************************************************/
+
+const backend g_backend = {
+	.name = "libevent",
+	.create = libevent_create,
+	.run = libevent_run,
+	.stop = libevent_stop,
+	.destroy = libevent_destroy,
+	.register_aerospike = libevent_register_aerospike,
+	.close_aerospike = libevent_close_aerospike,
+	.add_hooks = libevent_add_hooks,
+	.remove_hooks = libevent_remove_hooks,
+	.add_notifier = libevent_add_notifier,
+	.notify = libevent_notify,
+	.remove_notifier = libevent_remove_notifier
+};
@@ -0,0 +1,197 @@
+#include "backend.h"
+#include <stdlib.h>
+#include "affinity.h"
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+typedef struct {
+	uv_prepare_t prepare;
+	uv_check_t check;
+	backend_hook prepare_hook;
+	backend_hook check_hook;
+	void* udata;
+} libuv_hooks;
+
+typedef struct {
+	uv_async_t async;
+	backend_hook callback;
+	void* udata;
+} libuv_notifier;
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static void*
+libuv_create(bool single_thread)
+{
+	// Called on the loop's own thread, so the loop lands on its NUMA node.
+	uv_loop_t* loop = affinity_alloc_local(sizeof(uv_loop_t));
+	uv_loop_init(loop);
+	return loop;
+}
+
+static void
+libuv_run(void* native)
+{
+	uv_run(native, UV_RUN_DEFAULT);
+}
+
+static void
+connection_closed(uv_handle_t* socket)
+{
+	// socket->data has as_event_command ptr but that may have already been freed,
+	// so free as_event_connection ptr by socket which is first field in as_event_connection.
+	cf_free(socket);
+}
+
+static void
+close_walk(uv_handle_t* handle, void* arg)
+{
+	if (! uv_is_closing(handle)) {
+		if (handle->type == UV_TCP) {
+			// Give callback for known connection handles.
+			uv_close(handle, connection_closed);
+		}
+		else {
+			// Received unexpected handle.
+			// Close handle, but do not provide callback that might free unallocated data.
+			uv_close(handle, NULL);
+		}
+	}
+}
+
+static void
+libuv_destroy(void* native)
+{
+	// Close remaining handles and let their close callbacks run.
+	uv_walk(native, close_walk, NULL);
+	uv_run(native, UV_RUN_DEFAULT);
+	uv_loop_close(native);
+	affinity_free_local(native);
+}
+
+static void
+libuv_register_aerospike(as_event_loop* event_loop, aerospike* as)
+{
+}
+
+static void
+libuv_close_aerospike(as_event_loop* event_loop, aerospike* as)
+{
+	as_error err;
+	aerospike_close(as, &err);
+	aerospike_destroy(as);
+	as_event_close_loops();
+}
+
+static void
+libuv_prepare(uv_prepare_t* handle)
+{
+	libuv_hooks* hooks = handle->data;
+	hooks->prepare_hook(hooks->udata);
+}
+
+static void
+libuv_check(uv_check_t* handle)
+{
+	libuv_hooks* hooks = handle->data;
+	hooks->check_hook(hooks->udata);
+}
+
+static void*
+libuv_add_hooks(void* native, backend_hook prepare, backend_hook check, void* udata)
+{
+	libuv_hooks* hooks = malloc(sizeof(libuv_hooks));
+	hooks->prepare_hook = prepare;
+	hooks->check_hook = check;
+	hooks->udata = udata;
+
+	uv_prepare_init(native, &hooks->prepare);
+	hooks->prepare.data = hooks;
+	uv_prepare_start(&hooks->prepare, libuv_prepare);
+	uv_unref((uv_handle_t*)&hooks->prepare);
+
+	uv_check_init(native, &hooks->check);
+	hooks->check.data = hooks;
+	uv_check_start(&hooks->check, libuv_check);
+	uv_unref((uv_handle_t*)&hooks->check);
+	return hooks;
+}
+
+static void
+hooks_closed(uv_handle_t* handle)
+{
+	// Close callbacks run in close order, so prepare has already closed.
+	free(handle->data);
+}
+
+static void
+libuv_remove_hooks(void* udata)
+{
+	libuv_hooks* hooks = udata;
+
+	uv_close((uv_handle_t*)&hooks->prepare, NULL);
+	uv_close((uv_handle_t*)&hooks->check, hooks_closed);
+}
+
+static void
+libuv_notified(uv_async_t* handle)
+{
+	libuv_notifier* notifier = handle->data;
+	notifier->callback(notifier->udata);
+}
+
+static void*
+libuv_add_notifier(void* native, backend_hook callback, void* udata)
+{
+	libuv_notifier* notifier = malloc(sizeof(libuv_notifier));
+	notifier->callback = callback;
+	notifier->udata = udata;
+
+	uv_async_init(native, &notifier->async, libuv_notified);
+	notifier->async.data = notifier;
+	uv_unref((uv_handle_t*)&notifier->async);
+	return notifier;
+}
+
+static void
+libuv_notify(void* udata)
+{
+	libuv_notifier* notifier = udata;
+	uv_async_send(&notifier->async);
+}
+
+static void
+notifier_closed(uv_handle_t* handle)
+{
+	free(handle->data);
+}
+
+static void
+libuv_remove_notifier(void* udata)
+{
+	libuv_notifier* notifier = udata;
+	uv_close((uv_handle_t*)&notifier->async, notifier_closed);
+}
+
+/******************************************************************************
+ *	Backend
+ *****************************************************************************/
+
+const backend g_backend = {
+	.name = "libuv",
+	.create = libuv_create,
+	.run = libuv_run,
+	.stop = NULL,
+	.destroy = libuv_destroy,
+	.register_aerospike = libuv_register_aerospike,
+	.close_aerospike = libuv_close_aerospike,
+	.add_hooks = libuv_add_hooks,
+	.remove_hooks = libuv_remove_hooks,
+	.add_notifier = libuv_add_notifier,
+	.notify = libuv_notify,
+	.remove_notifier = libuv_remove_notifier
+};
@@ -0,0 +1,128 @@
+#!/bin/sh
+# Run the standard backend comparison matrix and write target/bench/report.csv
+# and target/bench/report.json.
+#
+# Usage: ./bench.sh [libev] [libuv] [libevent]
+#
+# Environment:
+#   BENCH_HOST      server host. If unset, target/mock_server is started.
+#   BENCH_PORT      server port (default 3000, or 3100 for the mock server).
+#   BENCH_DURATION  seconds per run, after warmup (default 10).
+#   BENCH_WARMUP    warmup seconds per run (default 2).
+#   BENCH_LOOPS     event loop counts (default "1 2 4 8").
+#   BENCH_RECORDS   keys per run (default 100000).
+#
+# The mock server is a single thread poll() loop, and every loop count runs
+# against that one thread. At higher loop counts it can saturate before the
+# client does, so check its cpu before reading a flat scaling curve as a
+# client limit, or set BENCH_HOST to a real cluster.
+
+LIBS=${*:-"libev libuv libevent"}
+DURATION=${BENCH_DURATION:-10}
+WARMUP=${BENCH_WARMUP:-2}
+LOOPS=${BENCH_LOOPS:-"1 2 4 8"}
+RECORDS=${BENCH_RECORDS:-100000}
+OUT=target/bench
+MOCK_PID=
+
+mkdir -p $OUT
+
+if [ -z "$BENCH_HOST" ]; then
+	HOST=127.0.0.1
+	PORT=${BENCH_PORT:-3100}
+	./target/mock_server -p $PORT > $OUT/mock_server.log &
+	MOCK_PID=$!
+	trap 'kill $MOCK_PID 2>/dev/null' EXIT INT TERM
+	sleep 1
+else
+	HOST=$BENCH_HOST
+	PORT=${BENCH_PORT:-3000}
+fi
+
+# Record shapes: name and value arguments.
+record_args() {
+	case $1 in
+		small) echo "-b 1 -v int";;
+		large) echo "-b 10 -v bytes:1024";;
+	esac
+}
+
+CSV=$OUT/report.csv
+JSON=$OUT/report.json
+echo "backend,mode,loops,record,ops_per_sec,errors,p50_us,p90_us,p99_us,p999_us,max_us,cpu_us_per_op,max_rss_kb" > $CSV
+
+for lib in $LIBS; do
+	bin=target/$lib/async_tutorial
+
+	if [ ! -x $bin ]; then
+		echo "Skipping $lib: $bin not built"
+		continue
+	fi
+
+	for mode in async pipeline coro; do
+		mode_args=
+		[ $mode = pipeline ] && mode_args=-l
+		[ $mode = coro ] && mode_args=-c
+
+		for loops in $LOOPS; do
+			for record in small large; do
+				log=$OUT/$lib-$mode-$loops-$record.log
+				echo "Running $lib $mode loops=$loops record=$record"
+
+				$bin -h $HOST -p $PORT -L $loops -k $RECORDS $mode_args $(record_args $record) \
+					-d $DURATION -w $WARMUP -i $DURATION > $log 2>&1
+
+				awk -v lib=$lib -v mode=$mode -v loops=$loops -v record=$record '
+					/^Write throughput:/ { ops = $3; errors = $5 }
+					/write latency \(us\):/ {
+						for (i = 1; i <= NF; i++) {
+							split($i, kv, "=")
+							v[kv[1]] = kv[2]
+						}
+					}
+					/^Process cpu:/ { cpu = $4; rss = $8 }
+					END {
+						if (ops == "") {
+							exit 1
+						}
+						printf "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n", lib, mode, loops, record,
+							ops, errors, v["p50"], v["p90"], v["p99"], v["p99.9"], v["max"], cpu, rss
+					}' $log >> $CSV || echo "  failed, see $log"
+			done
+		done
+	done
+done
+
+# Same rows as JSON.
+awk -F, '
+	NR == 1 { for (i = 1; i <= NF; i++) name[i] = $i; n = NF; next }
+	{
+		row = ""
+		for (i = 1; i <= n; i++) {
+			value = (i == 1 || i == 2 || i == 4) ? "\"" $i "\"" : ($i == "" ? "null" : $i)
+			row = row (i > 1 ? ", " : "") "\"" name[i] "\": " value
+		}
+		rows = rows (rows == "" ? "" : ",\n") "  {" row "}"
+	}
+	END { print "[\n" rows "\n]" }' $CSV > $JSON
+
+# Coroutine cost: coro rows against the async rows of the same backend,
+# loops and record shape. Positive cpu change means coroutines cost more.
+awk -F, '
+	NR == 1 { print "backend,loops,record,async_ops_per_sec,coro_ops_per_sec,ops_change_pct,async_cpu_us_per_op,coro_cpu_us_per_op,cpu_change_pct"; next }
+	$2 == "async" { ops[$1 "," $3 "," $4] = $5; cpu[$1 "," $3 "," $4] = $12 }
+	$2 == "coro" { coro[++n] = $0 }
+	END {
+		for (i = 1; i <= n; i++) {
+			split(coro[i], f, ",")
+			k = f[1] "," f[3] "," f[4]
+			if (! (k in ops)) {
+				continue
+			}
+			ops_pct = ops[k] > 0 ? (f[5] - ops[k]) * 100 / ops[k] : 0
+			cpu_pct = cpu[k] > 0 ? (f[12] - cpu[k]) * 100 / cpu[k] : 0
+			printf "%s,%s,%s,%.1f,%s,%s,%.1f\n", k, ops[k], f[5], ops_pct, cpu[k], f[12], cpu_pct
+		}
+	}' $CSV > $OUT/coro.csv
+
+echo "Wrote $CSV, $JSON and $OUT/coro.csv"
@@ -0,0 +1,146 @@
+#include "coro.h"
+#include "affinity.h"
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static inline void
+resume(coro* c, as_error* err)
+{
+	c->status = err ? err->code : AEROSPIKE_OK;
+	c->err = err;
+	c->fn(c);
+}
+
+static inline bool
+not_started(coro* c)
+{
+	// Listener will not be called. Continue the body synchronously.
+	c->status = c->arena->err.code;
+	c->err = &c->arena->err;
+	c->record = NULL;
+	return false;
+}
+
+static void
+put_listener(as_error* err, void* udata, as_event_loop* event_loop)
+{
+	resume(udata, err);
+}
+
+static void
+get_listener(as_error* err, as_record* record, void* udata, as_event_loop* event_loop)
+{
+	// Record is destroyed once this returns, so the body only sees it until
+	// its next await.
+	coro* c = udata;
+	c->record = record;
+	resume(c, err);
+}
+
+static void
+batch_listener(as_error* err, as_batch_read_records* records, void* udata, as_event_loop* event_loop)
+{
+	resume(udata, err);
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void
+coro_arena_init(coro_arena* a, aerospike* as, as_event_loop* event_loop, uint32_t frame_size, uint32_t capacity)
+{
+	// Frames are placed on the loop thread's NUMA node.
+	a->as = as;
+	a->event_loop = event_loop;
+	a->frames = affinity_alloc_local((size_t)frame_size * capacity);
+	a->frame_size = frame_size;
+	a->capacity = capacity;
+	a->free_list = NULL;
+
+	for (uint32_t i = capacity; i > 0; i--) {
+		coro* c = (coro*)(a->frames + (size_t)frame_size * (i - 1));
+		c->next = a->free_list;
+		a->free_list = c;
+	}
+}
+
+void
+coro_arena_destroy(coro_arena* a)
+{
+	if (a->frames) {
+		affinity_free_local(a->frames);
+		a->frames = NULL;
+	}
+}
+
+coro*
+coro_spawn(coro_arena* a, coro_fn fn, void* udata)
+{
+	coro* c = a->free_list;
+
+	if (! c) {
+		return NULL;
+	}
+
+	a->free_list = c->next;
+	c->fn = fn;
+	c->arena = a;
+	c->line = 0;
+	c->status = AEROSPIKE_OK;
+	c->err = NULL;
+	c->record = NULL;
+	c->udata = udata;
+	return c;
+}
+
+void
+coro_exit(coro* c)
+{
+	coro_arena* a = c->arena;
+
+	c->next = a->free_list;
+	a->free_list = c;
+}
+
+void
+coro_wake(void* udata)
+{
+	coro* c = udata;
+	c->fn(c);
+}
+
+bool
+coro_put(coro* c, const as_policy_write* policy, as_key* key, as_record* rec)
+{
+	coro_arena* a = c->arena;
+
+	if (aerospike_key_put_async(a->as, &a->err, policy, key, rec, put_listener, c, a->event_loop, NULL) != AEROSPIKE_OK) {
+		return not_started(c);
+	}
+	return true;
+}
+
+bool
+coro_get(coro* c, const as_policy_read* policy, as_key* key)
+{
+	coro_arena* a = c->arena;
+
+	if (aerospike_key_get_async(a->as, &a->err, policy, key, get_listener, c, a->event_loop, NULL) != AEROSPIKE_OK) {
+		return not_started(c);
+	}
+	return true;
+}
+
+bool
+coro_batch_read(coro* c, const as_policy_batch* policy, as_batch_read_records* records)
+{
+	coro_arena* a = c->arena;
+
+	if (aerospike_batch_read_async(a->as, &a->err, policy, records, batch_listener, c, a->event_loop) != AEROSPIKE_OK) {
+		return not_started(c);
+	}
+	return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <aerospike/aerospike.h>
+#include <aerospike/aerospike_batch.h>
+#include <aerospike/aerospike_key.h>
+#include <aerospike/as_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+typedef struct coro_s coro;
+typedef void (*coro_fn)(coro* c);
+
+// Stackless coroutine. Its body is a coro_fn, and its frame is a struct that
+// starts with this header. The body is entered from the top on every resume,
+// and CORO_BEGIN jumps to the CORO_AWAIT it last suspended at, so anything
+// that lives across an await must be a frame field, not a local.
+struct coro_s {
+	coro_fn fn;
+	struct coro_arena_s* arena;
+	struct coro_s* next;   // Next free frame. Free frames only.
+	uint32_t line;         // Resume point, or 0 before the first run.
+	as_status status;      // Result of the last await.
+	as_error* err;         // Error of the last await, or NULL. Valid until the next await.
+	as_record* record;     // Record of the last get. Valid until the next await.
+	void* udata;
+};
+
+// Fixed-capacity pool of equally sized frames owned by one event loop.
+// Spawning and exiting only pop and push a free list, so a coroutine costs
+// no allocation per command.
+typedef struct coro_arena_s {
+	aerospike* as;
+	as_event_loop* event_loop;
+	char* frames;
+	coro* free_list;
+	uint32_t frame_size;
+	uint32_t capacity;
+	as_error err;          // Error of an await that could not start.
+} coro_arena;
+
+/******************************************************************************
+ *	Macros
+ *****************************************************************************/
+
+#define CORO_BEGIN(c) switch ((c)->line) { case 0:
+
+// Evaluate op, which starts an async call that resumes c, and is true if the
+// call started. Suspends until the call completes. If it could not start,
+// status and err are already set and the body continues at once. The
+// listener may also run before op returns, in which case the body carries on
+// inside it and the outer call just returns. At most one await per line.
+#define CORO_AWAIT(c, op) \
+	do { \
+		(c)->line = __LINE__; \
+		if (op) { \
+			return; \
+		} \
+		__attribute__((fallthrough)); \
+		case __LINE__:; \
+	} while (0)
+
+// Suspend until coro_wake() is called, e.g. by a timer.
+#define CORO_YIELD(c) CORO_AWAIT(c, true)
+
+// Free the frame. Code after CORO_END runs once, and must not touch the frame.
+#define CORO_END(c) } coro_exit(c)
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Must be called from the event loop's thread.
+void coro_arena_init(coro_arena* a, aerospike* as, as_event_loop* event_loop, uint32_t frame_size, uint32_t capacity);
+
+void coro_arena_destroy(coro_arena* a);
+
+// Take a frame with its header set, or NULL if every frame is in use. Fill in
+// the rest of the frame, then start the body with coro_wake().
+coro* coro_spawn(coro_arena* a, coro_fn fn, void* udata);
+
+void coro_exit(coro* c);
+
+// Resume c. Has the signature of retry_callback and backend_hook, so a frame
+// can wait on a timer or notifier.
+void coro_wake(void* udata);
+
+// Awaitable commands on the arena's event loop.
+bool coro_put(coro* c, const as_policy_write* policy, as_key* key, as_record* rec);
+bool coro_get(coro* c, const as_policy_read* policy, as_key* key);
+bool coro_batch_read(coro* c, const as_policy_batch* policy, as_batch_read_records* records);
@@ -0,0 +1,133 @@
+#include "distribution.h"
+#include <math.h>
+#include <string.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static double
+zeta(uint64_t n, double theta)
+{
+	double sum = 0;
+
+	for (uint64_t i = 1; i <= n; i++) {
+		sum += 1.0 / pow((double)i, theta);
+	}
+	return sum;
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void
+distribution_init(distribution* d, distribution_type type, uint64_t min, uint64_t max)
+{
+	memset(d, 0, sizeof(distribution));
+	d->type = min == max ? DISTRIBUTION_FIXED : type;
+	d->min = min;
+	d->max = max;
+
+	if (d->type == DISTRIBUTION_ZIPF) {
+		// Gray et al., "Quickly Generating Billion-Record Synthetic Databases".
+		uint64_t n = max - min + 1;
+		d->theta = 0.99;
+		d->zetan = zeta(n, d->theta);
+		d->alpha = 1.0 / (1.0 - d->theta);
+		d->eta = (1.0 - pow(2.0 / n, 1.0 - d->theta)) / (1.0 - zeta(2, d->theta) / d->zetan);
+	}
+	else if (d->type == DISTRIBUTION_HOTSPOT) {
+		distribution_set_hotspot(d, 0.2, 0.8);
+	}
+}
+
+void
+distribution_set_hotspot(distribution* d, double hot_set, double hot_ops)
+{
+	d->hot_set = hot_set;
+	d->hot_ops = hot_ops;
+}
+
+bool
+distribution_parse_type(const char* name, distribution_type* type)
+{
+	if (strcmp(name, "fixed") == 0) {
+		*type = DISTRIBUTION_FIXED;
+	}
+	else if (strcmp(name, "uniform") == 0) {
+		*type = DISTRIBUTION_UNIFORM;
+	}
+	else if (strcmp(name, "zipf") == 0) {
+		*type = DISTRIBUTION_ZIPF;
+	}
+	else if (strcmp(name, "hotspot") == 0) {
+		*type = DISTRIBUTION_HOTSPOT;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+const char*
+distribution_type_name(distribution_type type)
+{
+	switch (type) {
+		case DISTRIBUTION_UNIFORM:
+			return "uniform";
+		case DISTRIBUTION_ZIPF:
+			return "zipf";
+		case DISTRIBUTION_HOTSPOT:
+			return "hotspot";
+		default:
+			return "fixed";
+	}
+}
+
+uint64_t
+distribution_next(const distribution* d, uint64_t* seed)
+{
+	switch (d->type) {
+		case DISTRIBUTION_UNIFORM:
+			return d->min + random_next(seed) % (d->max - d->min + 1);
+
+		case DISTRIBUTION_ZIPF: {
+			uint64_t n = d->max - d->min + 1;
+			double u = random_next_double(seed);
+			double uz = u * d->zetan;
+
+			if (uz < 1.0) {
+				return d->min;
+			}
+
+			if (uz < 1.0 + pow(0.5, d->theta)) {
+				return d->min + 1;
+			}
+
+			uint64_t v = (uint64_t)(n * pow(d->eta * u - d->eta + 1.0, d->alpha));
+			return d->min + (v < n ? v : n - 1);
+		}
+
+		case DISTRIBUTION_HOTSPOT: {
+			uint64_t n = d->max - d->min + 1;
+			uint64_t hot = (uint64_t)(n * d->hot_set);
+
+			if (hot == 0) {
+				hot = 1;
+			}
+
+			if (hot >= n) {
+				return d->min + random_next(seed) % n;
+			}
+
+			if (random_next_double(seed) < d->hot_ops) {
+				return d->min + random_next(seed) % hot;
+			}
+			return d->min + hot + random_next(seed) % (n - hot);
+		}
+
+		default:
+			return d->min;
+	}
+}
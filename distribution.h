@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+typedef enum {
+	DISTRIBUTION_FIXED,
+	DISTRIBUTION_UNIFORM,
+	DISTRIBUTION_ZIPF,
+	DISTRIBUTION_HOTSPOT
+} distribution_type;
+
+// Integer distribution over [min, max]. Zipf favors values close to min.
+// Hotspot sends hot_ops of all draws uniformly to the first hot_set of the
+// range, and the rest uniformly to the remainder.
+typedef struct {
+	distribution_type type;
+	uint64_t min;
+	uint64_t max;
+	double theta;
+	double zetan;
+	double alpha;
+	double eta;
+	double hot_set;
+	double hot_ops;
+} distribution;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Zipf initialization is O(max - min), so do it once at startup.
+void distribution_init(distribution* d, distribution_type type, uint64_t min, uint64_t max);
+
+// Change hotspot fractions (default 0.2 of the range gets 0.8 of draws).
+void distribution_set_hotspot(distribution* d, double hot_set, double hot_ops);
+
+// Parse distribution name ("fixed", "uniform", "zipf" or "hotspot").
+bool distribution_parse_type(const char* name, distribution_type* type);
+
+const char* distribution_type_name(distribution_type type);
+
+uint64_t distribution_next(const distribution* d, uint64_t* seed);
+
+// Fast xorshift64* generator. Each event loop keeps its own seed.
+static inline uint64_t
+random_next(uint64_t* seed)
+{
+	uint64_t x = *seed;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*seed = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform double in [0, 1).
+static inline double
+random_next_double(uint64_t* seed)
+{
+	return (random_next(seed) >> 11) * (1.0 / 9007199254740992.0);
+}
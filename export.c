@@ -0,0 +1,343 @@
+#include "export.h"
+#include "loader.h"
+#include <aerospike/as_atomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static char*
+reserve(export_buffer* b, size_t size)
+{
+	if (b->size + size > b->capacity) {
+		size_t capacity = b->capacity ? b->capacity : 4096;
+
+		while (capacity < b->size + size) {
+			capacity *= 2;
+		}
+		b->data = realloc(b->data, capacity);
+		b->capacity = capacity;
+	}
+
+	char* p = b->data + b->size;
+	b->size += size;
+	return p;
+}
+
+static void
+append(export_buffer* b, const void* data, size_t size)
+{
+	memcpy(reserve(b, size), data, size);
+}
+
+static inline void
+write_u32(char* p, uint32_t v)
+{
+	p[0] = (char)v;
+	p[1] = (char)(v >> 8);
+	p[2] = (char)(v >> 16);
+	p[3] = (char)(v >> 24);
+}
+
+static void
+append_binary(export_buffer* b, loader_type type, const void* data, uint32_t size)
+{
+	char* p = reserve(b, 5 + size);
+
+	p[0] = (char)type;
+	write_u32(p + 1, size);
+	memcpy(p + 5, data, size);
+}
+
+static void
+append_hex(export_buffer* b, const uint8_t* data, uint32_t size)
+{
+	static const char digits[] = "0123456789abcdef";
+	char* p = reserve(b, (size_t)size * 2);
+
+	for (uint32_t i = 0; i < size; i++) {
+		p[i * 2] = digits[data[i] >> 4];
+		p[i * 2 + 1] = digits[data[i] & 0xf];
+	}
+}
+
+static void
+append_csv_string(export_buffer* b, const char* s, size_t size)
+{
+	if (strcspn(s, ",\"\r\n") >= size) {
+		append(b, s, size);
+		return;
+	}
+
+	// Quote the field and double embedded quotes.
+	append(b, "\"", 1);
+
+	for (size_t i = 0; i < size; i++) {
+		if (s[i] == '"') {
+			append(b, "\"", 1);
+		}
+		append(b, &s[i], 1);
+	}
+	append(b, "\"", 1);
+}
+
+static void
+append_value(export_buffer* b, export_format format, const as_val* val)
+{
+	char str[32];
+	char* alloc = NULL;
+	const char* s;
+	size_t size;
+
+	switch (as_val_type(val)) {
+		case AS_INTEGER: {
+			int64_t v = as_integer_get((const as_integer*)val);
+
+			if (format == EXPORT_BINARY) {
+				char data[8];
+				write_u32(data, (uint32_t)v);
+				write_u32(data + 4, (uint32_t)((uint64_t)v >> 32));
+				append_binary(b, LOADER_INT, data, 8);
+				return;
+			}
+			append(b, str, snprintf(str, sizeof(str), "%lld", (long long)v));
+			return;
+		}
+		case AS_BYTES: {
+			const as_bytes* v = (const as_bytes*)val;
+
+			if (format == EXPORT_BINARY) {
+				append_binary(b, LOADER_BYTES, as_bytes_get(v), as_bytes_size(v));
+			}
+			else {
+				append_hex(b, as_bytes_get(v), as_bytes_size(v));
+			}
+			return;
+		}
+		case AS_STRING:
+			s = as_string_get((const as_string*)val);
+			size = as_string_len((as_string*)val);
+			break;
+		case AS_DOUBLE:
+			size = snprintf(str, sizeof(str), "%.17g", as_double_get((const as_double*)val));
+			s = str;
+			break;
+		default:
+			// Collections and other types in their printed form.
+			alloc = as_val_tostring(val);
+			s = alloc ? alloc : "";
+			size = strlen(s);
+			break;
+	}
+
+	if (format == EXPORT_BINARY) {
+		append_binary(b, LOADER_STRING, s, (uint32_t)size);
+	}
+	else {
+		append_csv_string(b, s, size);
+	}
+	free(alloc);
+}
+
+static void*
+writer_thread(void* udata)
+{
+	export_writer* w = udata;
+
+	while (true) {
+		pthread_mutex_lock(&w->lock);
+
+		while (! w->flushing && ! w->stop) {
+			pthread_cond_wait(&w->cond, &w->lock);
+		}
+
+		export_buffer* b = w->flushing;
+		pthread_mutex_unlock(&w->lock);
+
+		if (! b) {
+			break;
+		}
+
+		// Reserve this buffer's file range, then write without holding any
+		// lock shared with other writers.
+		uint64_t offset = as_faa_uint64(&w->file->offset, b->size);
+		size_t done = 0;
+
+		while (done < b->size && ! w->failed) {
+			ssize_t rv = pwrite(w->file->fd, b->data + done, b->size - done, (off_t)(offset + done));
+
+			if (rv < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				printf("Failed to write export file: %s\n", strerror(errno));
+				w->failed = true;
+				break;
+			}
+			done += rv;
+		}
+		w->bytes += done;
+
+		pthread_mutex_lock(&w->lock);
+		b->size = 0;
+		w->flushing = NULL;
+		pthread_mutex_unlock(&w->lock);
+
+		w->flushed(w->udata);
+	}
+	return NULL;
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+export_format
+export_format_from_path(const char* path)
+{
+	size_t len = strlen(path);
+
+	if (len >= 4 && strcasecmp(path + len - 4, ".csv") == 0) {
+		return EXPORT_CSV;
+	}
+	return EXPORT_BINARY;
+}
+
+bool
+export_file_open(export_file* f, const char* path, export_format format)
+{
+	f->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (f->fd < 0) {
+		return false;
+	}
+
+	f->format = format;
+	f->offset = 0;
+
+	if (format == EXPORT_BINARY) {
+		if (write(f->fd, LOADER_MAGIC, LOADER_MAGIC_SIZE) != LOADER_MAGIC_SIZE) {
+			close(f->fd);
+			return false;
+		}
+		f->offset = LOADER_MAGIC_SIZE;
+	}
+	return true;
+}
+
+void
+export_file_close(export_file* f)
+{
+	close(f->fd);
+}
+
+bool
+export_writer_init(export_writer* w, export_file* f, size_t limit, export_flushed_callback flushed, void* udata)
+{
+	memset(w, 0, sizeof(*w));
+	w->file = f;
+	w->active = &w->buffers[0];
+	w->limit = limit;
+	w->flushed = flushed;
+	w->udata = udata;
+
+	// Both buffers start at their full size, so steady state never grows them.
+	for (uint32_t i = 0; i < 2; i++) {
+		reserve(&w->buffers[i], limit);
+		w->buffers[i].size = 0;
+	}
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+
+	if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+		pthread_cond_destroy(&w->cond);
+		pthread_mutex_destroy(&w->lock);
+		free(w->buffers[0].data);
+		free(w->buffers[1].data);
+		w->file = NULL;
+		return false;
+	}
+	return true;
+}
+
+void
+export_writer_close(export_writer* w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->stop = true;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_join(w->thread, NULL);
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+	free(w->buffers[0].data);
+	free(w->buffers[1].data);
+}
+
+void
+export_writer_append(export_writer* w, const as_record* rec)
+{
+	export_buffer* b = w->active;
+	export_format format = w->file->format;
+	const as_key* key = &rec->key;
+	uint16_t n_bins = rec->bins.size;
+
+	if (format == EXPORT_BINARY) {
+		char* p = reserve(b, 2);
+		p[0] = (char)n_bins;
+		p[1] = (char)(n_bins >> 8);
+
+		if (key->valuep) {
+			append_value(b, format, (const as_val*)key->valuep);
+		}
+		else {
+			append_binary(b, LOADER_BYTES, key->digest.value, AS_DIGEST_VALUE_SIZE);
+		}
+	}
+	else {
+		if (key->valuep) {
+			append_value(b, format, (const as_val*)key->valuep);
+		}
+		else {
+			append_hex(b, key->digest.value, AS_DIGEST_VALUE_SIZE);
+		}
+	}
+
+	for (uint16_t i = 0; i < n_bins; i++) {
+		if (format == EXPORT_CSV) {
+			append(b, ",", 1);
+		}
+		append_value(b, format, (const as_val*)rec->bins.entries[i].valuep);
+	}
+
+	if (format == EXPORT_CSV) {
+		append(b, "\n", 1);
+	}
+}
+
+bool
+export_writer_flush(export_writer* w)
+{
+	if (w->pending || w->active->size == 0) {
+		return false;
+	}
+
+	// Writer thread is idle, since its last flush was acknowledged. Swap
+	// buffers and wake it.
+	pthread_mutex_lock(&w->lock);
+	w->flushing = w->active;
+	w->active = (w->active == &w->buffers[0]) ? &w->buffers[1] : &w->buffers[0];
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	w->pending = true;
+	return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <aerospike/as_record.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+// Output formats. Binary is the loader's binary format (see loader.h), so an
+// export can be loaded back with -f. CSV has one record per line, the key
+// followed by bin values. Records without a stored user key are keyed by
+// their digest, as bytes in binary output and hex in CSV. Bin names are not
+// kept. Doubles, lists and maps are written as strings.
+typedef enum {
+	EXPORT_BINARY,
+	EXPORT_CSV
+} export_format;
+
+// Called from the writer thread after a buffer has been written.
+typedef void (*export_flushed_callback)(void* udata);
+
+typedef struct {
+	char* data;
+	size_t size;
+	size_t capacity;
+} export_buffer;
+
+// Output file shared by every writer. Each flush reserves its own file range,
+// so writers never wait on each other and records from different event loops
+// are interleaved a buffer at a time.
+typedef struct {
+	int fd;
+	export_format format;
+	uint64_t offset;  // Next free file offset.
+} export_file;
+
+// Double-buffered writer owned by one event loop. The loop serializes records
+// into the active buffer while a writer thread writes the other buffer, so
+// the loop never blocks on file I/O. A buffer may grow past limit while a scan
+// page completes, and keeps its capacity, so memory is bounded by two
+// buffers of limit plus one page of records.
+typedef struct {
+	export_file* file;
+	export_buffer buffers[2];
+	export_buffer* active;    // Filled by the event loop.
+	export_buffer* flushing;  // Being written by the writer thread, or NULL.
+	size_t limit;             // Active buffer is full at this size.
+	export_flushed_callback flushed;
+	void* udata;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint64_t bytes;           // Bytes written. Writer thread only.
+	bool pending;             // Flush not yet acknowledged. Event loop only.
+	bool stop;
+	bool failed;
+} export_writer;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Binary unless path ends in ".csv".
+export_format export_format_from_path(const char* path);
+
+// Create or truncate output file. Binary output starts with LOADER_MAGIC.
+bool export_file_open(export_file* f, const char* path, export_format format);
+
+void export_file_close(export_file* f);
+
+// Start writer thread. The thread inherits the caller's cpu affinity, so call
+// from the owning event loop thread. On failure w->file is NULL.
+bool export_writer_init(export_writer* w, export_file* f, size_t limit, export_flushed_callback flushed, void* udata);
+
+// Flush nothing further, stop writer thread and free buffers.
+void export_writer_close(export_writer* w);
+
+// Serialize record into the active buffer.
+void export_writer_append(export_writer* w, const as_record* rec);
+
+static inline bool
+export_writer_full(const export_writer* w)
+{
+	return w->active->size >= w->limit;
+}
+
+// Hand active buffer to the writer thread. Returns false if the active buffer
+// is empty, or the previous flush has not been acknowledged yet.
+bool export_writer_flush(export_writer* w);
+
+// Acknowledge a flushed callback. Must be called on the owning event loop
+// before the next export_writer_flush().
+static inline void
+export_writer_done(export_writer* w)
+{
+	w->pending = false;
+}
@@ -0,0 +1,79 @@
+#include "histogram.h"
+#include <stdio.h>
+#include <string.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static uint64_t
+bucket_upper_bound(uint32_t index)
+{
+	if (index < HISTOGRAM_SUB_COUNT) {
+		return index;
+	}
+
+	uint32_t shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+	uint64_t sub = HISTOGRAM_SUB_COUNT + (index & (HISTOGRAM_SUB_COUNT - 1));
+	return ((sub + 1) << shift) - 1;
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void
+histogram_init(histogram* h)
+{
+	memset(h, 0, sizeof(histogram));
+}
+
+void
+histogram_merge(histogram* dst, const histogram* src)
+{
+	for (uint32_t i = 0; i < HISTOGRAM_SIZE; i++) {
+		dst->buckets[i] += src->buckets[i];
+	}
+	dst->count += src->count;
+
+	if (src->max > dst->max) {
+		dst->max = src->max;
+	}
+}
+
+uint64_t
+histogram_percentile(const histogram* h, double percentile)
+{
+	if (h->count == 0) {
+		return 0;
+	}
+
+	uint64_t target = (uint64_t)(h->count * percentile / 100.0 + 0.5);
+	uint64_t sum = 0;
+
+	if (target == 0) {
+		target = 1;
+	}
+
+	for (uint32_t i = 0; i < HISTOGRAM_SIZE; i++) {
+		sum += h->buckets[i];
+
+		if (sum >= target) {
+			uint64_t value = bucket_upper_bound(i);
+			return value < h->max ? value : h->max;
+		}
+	}
+	return h->max;
+}
+
+void
+histogram_print(const histogram* h, const char* name)
+{
+	printf("%s latency (us): count=%llu p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+		name, (unsigned long long)h->count,
+		histogram_percentile(h, 50.0) / 1000.0,
+		histogram_percentile(h, 90.0) / 1000.0,
+		histogram_percentile(h, 99.0) / 1000.0,
+		histogram_percentile(h, 99.9) / 1000.0,
+		h->max / 1000.0);
+}
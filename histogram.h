@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+// Log-linear (HDR style) latency histogram. Each power of two range is split
+// into HISTOGRAM_SUB_COUNT linear sub-buckets, giving ~3% relative precision
+// across the full 64-bit range. A histogram has a single writer (its event
+// loop), so recording is a plain increment with no locks or atomics.
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_SIZE ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+typedef struct {
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[HISTOGRAM_SIZE];
+} histogram;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void histogram_init(histogram* h);
+void histogram_merge(histogram* dst, const histogram* src);
+
+// Return value at percentile (0-100), in recorded units.
+uint64_t histogram_percentile(const histogram* h, double percentile);
+
+// Print count, p50/p90/p99/p99.9 and max. Values are recorded in nanoseconds
+// and printed in microseconds.
+void histogram_print(const histogram* h, const char* name);
+
+static inline uint32_t
+histogram_index(uint64_t value)
+{
+	if (value < HISTOGRAM_SUB_COUNT) {
+		return (uint32_t)value;
+	}
+
+	uint32_t msb = 63 - __builtin_clzll(value);
+	uint32_t shift = msb - HISTOGRAM_SUB_BITS;
+	return ((shift + 1) << HISTOGRAM_SUB_BITS) + (uint32_t)((value >> shift) - HISTOGRAM_SUB_COUNT);
+}
+
+static inline void
+histogram_add(histogram* h, uint64_t value)
+{
+	h->buckets[histogram_index(value)]++;
+	h->count++;
+
+	if (value > h->max) {
+		h->max = value;
+	}
+}
+
+// Monotonic clock in nanoseconds.
+static inline uint64_t
+histogram_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
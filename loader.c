@@ -0,0 +1,282 @@
+#include "loader.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static inline uint32_t
+read_u32(const char* p)
+{
+	const uint8_t* b = (const uint8_t*)p;
+	return b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static inline int64_t
+read_i64(const char* p)
+{
+	return (int64_t)(read_u32(p) | ((uint64_t)read_u32(p + 4) << 32));
+}
+
+// Binary record size, or 0 if the record runs past end.
+static size_t
+binary_record_size(const char* p, const char* end)
+{
+	const char* begin = p;
+
+	if (end - p < 2) {
+		return 0;
+	}
+
+	uint32_t n_values = (uint8_t)p[0] | ((uint8_t)p[1] << 8);
+	p += 2;
+
+	// Key plus bins.
+	for (uint32_t i = 0; i <= n_values; i++) {
+		if (end - p < 5) {
+			return 0;
+		}
+
+		uint32_t size = read_u32(p + 1);
+		p += 5;
+
+		if ((size_t)(end - p) < size) {
+			return 0;
+		}
+		p += size;
+	}
+	return p - begin;
+}
+
+static void
+parse_text_value(const char* p, uint32_t size, loader_value* v)
+{
+	v->data = p;
+	v->size = size;
+
+	// Integers up to 18 digits fit in int64 without overflow checks.
+	uint32_t i = (size > 0 && p[0] == '-') ? 1 : 0;
+
+	if (size == i || size - i > 18) {
+		v->type = LOADER_STRING;
+		return;
+	}
+
+	int64_t n = 0;
+
+	for (uint32_t j = i; j < size; j++) {
+		if (p[j] < '0' || p[j] > '9') {
+			v->type = LOADER_STRING;
+			return;
+		}
+		n = n * 10 + (p[j] - '0');
+	}
+	v->type = LOADER_INT;
+	v->integer = i ? -n : n;
+}
+
+static int
+next_text(const char** pos, const char* end, loader_record* rec, uint32_t max_bins)
+{
+	const char* p = *pos;
+	const char* eol;
+
+	// Skip empty lines.
+	while (p < end && (*p == '\n' || *p == '\r')) {
+		p++;
+	}
+
+	if (p == end) {
+		*pos = p;
+		return 0;
+	}
+
+	eol = memchr(p, '\n', end - p);
+
+	if (! eol) {
+		eol = end;
+	}
+	*pos = eol < end ? eol + 1 : end;
+
+	const char* line_end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+	uint32_t field = 0;
+
+	rec->n_bins = 0;
+
+	while (p <= line_end) {
+		const char* tab = memchr(p, '\t', line_end - p);
+		const char* field_end = tab ? tab : line_end;
+
+		if (field == 0) {
+			parse_text_value(p, (uint32_t)(field_end - p), &rec->key);
+		}
+		else if (rec->n_bins < max_bins) {
+			parse_text_value(p, (uint32_t)(field_end - p), &rec->bins[rec->n_bins++]);
+		}
+		else {
+			return -1;
+		}
+
+		field++;
+
+		if (! tab) {
+			break;
+		}
+		p = tab + 1;
+	}
+	return (rec->key.size > 0 && rec->n_bins > 0) ? 1 : -1;
+}
+
+static bool
+parse_binary_value(const char** pos, loader_value* v)
+{
+	const char* p = *pos;
+
+	v->type = (loader_type)(uint8_t)p[0];
+	v->size = read_u32(p + 1);
+	v->data = p + 5;
+	*pos = p + 5 + v->size;
+
+	switch (v->type) {
+		case LOADER_INT:
+			if (v->size != 8) {
+				return false;
+			}
+			v->integer = read_i64(v->data);
+			return true;
+		case LOADER_STRING:
+		case LOADER_BYTES:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static int
+next_binary(const char** pos, const char* end, loader_record* rec, uint32_t max_bins)
+{
+	const char* p = *pos;
+
+	if (p == end) {
+		return 0;
+	}
+
+	size_t size = binary_record_size(p, end);
+
+	if (size == 0) {
+		// Truncated record. Nothing after it can be trusted.
+		*pos = end;
+		return -1;
+	}
+	*pos = p + size;
+
+	uint32_t n_bins = (uint8_t)p[0] | ((uint8_t)p[1] << 8);
+	bool valid = n_bins > 0 && n_bins <= max_bins;
+
+	p += 2;
+	valid = parse_binary_value(&p, &rec->key) && valid;
+	rec->n_bins = 0;
+
+	for (uint32_t i = 0; valid && i < n_bins; i++) {
+		valid = parse_binary_value(&p, &rec->bins[rec->n_bins++]);
+	}
+	return valid ? 1 : -1;
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+bool
+loader_open(loader_file* f, const char* path)
+{
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	// Each loop reads its own range front to back.
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	f->data = data;
+	f->size = st.st_size;
+
+	if (f->size >= LOADER_MAGIC_SIZE && memcmp(f->data, LOADER_MAGIC, LOADER_MAGIC_SIZE) == 0) {
+		f->format = LOADER_BINARY;
+		f->begin = f->data + LOADER_MAGIC_SIZE;
+	}
+	else {
+		f->format = LOADER_TEXT;
+		f->begin = f->data;
+	}
+	return true;
+}
+
+void
+loader_close(loader_file* f)
+{
+	munmap((void*)f->data, f->size);
+}
+
+void
+loader_split(const loader_file* f, uint32_t count, const char** bounds)
+{
+	const char* file_end = f->data + f->size;
+	size_t size = file_end - f->begin;
+	const char* p = f->begin;
+
+	for (uint32_t i = 0; i <= count; i++) {
+		const char* target = f->begin + size * i / count;
+
+		if (target == f->begin || target == file_end) {
+			bounds[i] = target;
+		}
+		else if (f->format == LOADER_TEXT) {
+			// Range starts after the line containing target.
+			const char* eol = memchr(target - 1, '\n', file_end - target + 1);
+			bounds[i] = eol ? eol + 1 : file_end;
+		}
+		else {
+			// Binary records can only be found by walking from the start.
+			// Targets ascend, so the walk carries on from the last bound.
+			while (p < target) {
+				size_t record_size = binary_record_size(p, file_end);
+
+				if (record_size == 0) {
+					p = file_end;
+					break;
+				}
+				p += record_size;
+			}
+			bounds[i] = p;
+		}
+	}
+}
+
+int
+loader_next(const loader_file* f, const char** pos, const char* end, loader_record* rec, uint32_t max_bins)
+{
+	if (f->format == LOADER_TEXT) {
+		return next_text(pos, end, rec, max_bins);
+	}
+	return next_binary(pos, end, rec, max_bins);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+// Input formats. Binary files start with LOADER_MAGIC, anything else is read
+// as text: one record per line, key then bin values separated by tabs.
+// Values that look like integers are loaded as integers, others as strings.
+//
+// Binary record (little endian):
+//   <n_bins:u16> <key value> <n_bins values>
+// Value:
+//   <type:u8> <size:u32> <data>   type is LOADER_INT (size 8), LOADER_STRING
+//                                 or LOADER_BYTES.
+#define LOADER_MAGIC "ASLOAD1\n"
+#define LOADER_MAGIC_SIZE 8
+
+typedef enum {
+	LOADER_TEXT,
+	LOADER_BINARY
+} loader_format;
+
+typedef enum {
+	LOADER_INT = 1,
+	LOADER_STRING = 3,
+	LOADER_BYTES = 4
+} loader_type;
+
+// Value pointing straight into the mapped file. Strings are not terminated.
+typedef struct {
+	loader_type type;
+	const char* data;
+	uint32_t size;
+	int64_t integer;
+} loader_value;
+
+typedef struct {
+	loader_value key;
+	uint32_t n_bins;
+	loader_value* bins;  // Caller supplied, max_bins entries.
+} loader_record;
+
+typedef struct {
+	const char* data;    // Whole mapping.
+	size_t size;
+	const char* begin;   // First record.
+	loader_format format;
+} loader_file;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Map file read-only and detect its format.
+bool loader_open(loader_file* f, const char* path);
+
+void loader_close(loader_file* f);
+
+// Split file into count byte ranges on record boundaries. Range i runs from
+// bounds[i] to bounds[i + 1], so bounds holds count + 1 entries. Ranges are
+// roughly equal in bytes.
+void loader_split(const loader_file* f, uint32_t count, const char** bounds);
+
+// Parse record at *pos and advance past it. Returns 1 on success, 0 at end of
+// range, or -1 if the record was malformed or had more than max_bins bins,
+// in which case it is skipped.
+int loader_next(const loader_file* f, const char** pos, const char* end, loader_record* rec, uint32_t max_bins);
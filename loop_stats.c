@@ -0,0 +1,136 @@
+#include "loop_stats.h"
+#include "backend.h"
+#include "histogram.h"
+#include <aerospike/as_atomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static void
+sample(loop_stats* s, uint64_t now)
+{
+#if defined(RUSAGE_THREAD)
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+		s->user_us = (uint64_t)usage.ru_utime.tv_sec * 1000000 + usage.ru_utime.tv_usec;
+		s->system_us = (uint64_t)usage.ru_stime.tv_sec * 1000000 + usage.ru_stime.tv_usec;
+		s->voluntary_switches = usage.ru_nvcsw;
+		s->involuntary_switches = usage.ru_nivcsw;
+	}
+#endif
+	s->sample_time = now;
+	s->next_sample = now + LOOP_STATS_SAMPLE_NS;
+}
+
+static void
+prepare_hook(void* udata)
+{
+	loop_stats* s = udata;
+	s->prepare_time = histogram_now();
+}
+
+static void
+check_hook(void* udata)
+{
+	loop_stats* s = udata;
+	uint64_t now = histogram_now();
+
+	s->iterations++;
+	s->wait_ns += now - s->prepare_time;
+
+	if (now >= s->next_sample) {
+		sample(s, now);
+	}
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void
+loop_stats_start(loop_stats* s, void* native)
+{
+	memset(s, 0, sizeof(loop_stats));
+
+	uint64_t now = histogram_now();
+	s->start_time = now;
+	s->prepare_time = now;
+	sample(s, now);
+	s->start_user_us = s->user_us;
+	s->start_system_us = s->system_us;
+	s->start_voluntary_switches = s->voluntary_switches;
+	s->start_involuntary_switches = s->involuntary_switches;
+	s->hooks = g_backend.add_hooks(native, prepare_hook, check_hook, s);
+}
+
+void
+loop_stats_stop(loop_stats* s)
+{
+	if (s->hooks) {
+		g_backend.remove_hooks(s->hooks);
+		s->hooks = NULL;
+	}
+	sample(s, histogram_now());
+}
+
+void
+loop_stats_snapshot(loop_stats* dst, const loop_stats* src)
+{
+	// Aligned 64-bit loads do not tear. Fields may be from slightly
+	// different moments, which is fine for reporting.
+	dst->hooks = as_load_ptr(&src->hooks);
+	dst->start_time = as_load_uint64(&src->start_time);
+	dst->sample_time = as_load_uint64(&src->sample_time);
+	dst->next_sample = as_load_uint64(&src->next_sample);
+	dst->prepare_time = as_load_uint64(&src->prepare_time);
+	dst->iterations = as_load_uint64(&src->iterations);
+	dst->wait_ns = as_load_uint64(&src->wait_ns);
+	dst->user_us = as_load_uint64(&src->user_us);
+	dst->system_us = as_load_uint64(&src->system_us);
+	dst->voluntary_switches = as_load_uint64(&src->voluntary_switches);
+	dst->involuntary_switches = as_load_uint64(&src->involuntary_switches);
+	dst->start_user_us = src->start_user_us;
+	dst->start_system_us = src->start_system_us;
+	dst->start_voluntary_switches = src->start_voluntary_switches;
+	dst->start_involuntary_switches = src->start_involuntary_switches;
+}
+
+void
+loop_stats_print(uint32_t index, const loop_stats* cur, const loop_stats* prev, uint64_t events)
+{
+	loop_stats start;
+
+	if (! prev) {
+		memset(&start, 0, sizeof(start));
+		start.sample_time = cur->start_time;
+		start.user_us = cur->start_user_us;
+		start.system_us = cur->start_system_us;
+		start.voluntary_switches = cur->start_voluntary_switches;
+		start.involuntary_switches = cur->start_involuntary_switches;
+		prev = &start;
+	}
+
+	double elapsed = cur->sample_time > prev->sample_time ?
+		(cur->sample_time - prev->sample_time) / 1000.0 : 1.0;  // Microseconds.
+	uint64_t iterations = cur->iterations - prev->iterations;
+
+	printf("Loop %u: user=%.1f%% sys=%.1f%% csw=%llu/%llu",
+		index,
+		(cur->user_us - prev->user_us) * 100.0 / elapsed,
+		(cur->system_us - prev->system_us) * 100.0 / elapsed,
+		(unsigned long long)(cur->voluntary_switches - prev->voluntary_switches),
+		(unsigned long long)(cur->involuntary_switches - prev->involuntary_switches));
+
+	if (cur->hooks || cur->iterations) {
+		printf(" wait=%.1f%% iterations=%llu events/iteration=%.1f",
+			(cur->wait_ns - prev->wait_ns) / 10.0 / elapsed,
+			(unsigned long long)iterations,
+			iterations ? (double)events / iterations : 0.0);
+	}
+	printf("\n");
+}
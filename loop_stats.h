@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+// Where an event loop thread spends its time. Written only by its own loop
+// thread: iterations and I/O wait come from backend prepare/check hooks, and
+// thread cpu time and context switches are sampled with getrusage() at most
+// every LOOP_STATS_SAMPLE_NS while the loop is running.
+#define LOOP_STATS_SAMPLE_NS 100000000
+
+typedef struct {
+	void* hooks;                    // NULL if event library has no hooks.
+	uint64_t start_time;
+	uint64_t sample_time;           // When rusage fields were sampled.
+	uint64_t next_sample;
+	uint64_t prepare_time;          // When loop last started waiting.
+	uint64_t iterations;
+	uint64_t wait_ns;               // Time blocked waiting for I/O.
+	uint64_t user_us;
+	uint64_t system_us;
+	uint64_t voluntary_switches;    // Thread blocked, usually on I/O.
+	uint64_t involuntary_switches;  // Thread preempted.
+	uint64_t start_user_us;         // Thread rusage is cumulative, so keep
+	uint64_t start_system_us;       // values at start for exit totals.
+	uint64_t start_voluntary_switches;
+	uint64_t start_involuntary_switches;
+} loop_stats;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Start accounting for loop. Must be called in the loop thread.
+void loop_stats_start(loop_stats* s, void* native);
+
+// Take a final sample and remove hooks. Must be called in the loop thread.
+void loop_stats_stop(loop_stats* s);
+
+// Copy stats owned by another loop thread.
+void loop_stats_snapshot(loop_stats* dst, const loop_stats* src);
+
+// Print cpu, wait and context switches as a share of elapsed time between
+// prev and cur, or since start if prev is NULL. Events are whatever the
+// caller counts as handled work, averaged per loop iteration.
+void loop_stats_print(uint32_t index, const loop_stats* cur, const loop_stats* prev, uint64_t events);
@@ -0,0 +1,109 @@
+#include "loop_timer.h"
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+#if defined(AS_USE_LIBUV)
+
+static void
+timer_fired(uv_timer_t* timer)
+{
+	loop_timer* t = timer->data;
+	t->callback(t->udata);
+}
+
+#elif defined(AS_USE_LIBEVENT)
+
+static void
+timer_fired(evutil_socket_t fd, short events, void* udata)
+{
+	loop_timer* t = udata;
+	t->callback(t->udata);
+}
+
+#else
+
+static void
+timer_fired(struct ev_loop* loop, ev_timer* timer, int revents)
+{
+	loop_timer* t = timer->data;
+	t->callback(t->udata);
+}
+
+#endif
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void
+loop_timer_init(loop_timer* t, as_event_loop* event_loop, loop_timer_callback callback, void* udata)
+{
+	t->callback = callback;
+	t->udata = udata;
+
+#if defined(AS_USE_LIBUV)
+	uv_timer_init(event_loop->loop, &t->timer);
+	t->timer.data = t;
+#elif defined(AS_USE_LIBEVENT)
+	t->timer = evtimer_new(event_loop->loop, timer_fired, t);
+#else
+	ev_init(&t->timer, timer_fired);
+	t->timer.data = t;
+	t->loop = event_loop->loop;
+#endif
+}
+
+void
+loop_timer_start(loop_timer* t, uint64_t delay_us, uint64_t repeat_us)
+{
+#if defined(AS_USE_LIBUV)
+	// libuv has millisecond resolution. Round up so timers never fire early.
+	uint64_t delay_ms = (delay_us + 999) / 1000;
+	uint64_t repeat_ms = (repeat_us + 999) / 1000;
+	uv_timer_start(&t->timer, timer_fired, delay_ms, repeat_ms);
+#elif defined(AS_USE_LIBEVENT)
+	// Persistent events re-arm with the timeout they were added with, so a
+	// repeating timer's first expiry uses repeat_us rather than delay_us.
+	uint64_t timeout_us = repeat_us ? repeat_us : delay_us;
+	struct timeval tv = {
+		.tv_sec = timeout_us / 1000000,
+		.tv_usec = timeout_us % 1000000
+	};
+	struct event_base* base = event_get_base(t->timer);
+
+	event_del(t->timer);
+	event_assign(t->timer, base, -1, repeat_us ? EV_PERSIST : 0, timer_fired, t);
+	evtimer_add(t->timer, &tv);
+#else
+	ev_timer_stop(t->loop, &t->timer);
+	ev_timer_set(&t->timer, delay_us / 1000000.0, repeat_us / 1000000.0);
+	ev_timer_start(t->loop, &t->timer);
+#endif
+}
+
+void
+loop_timer_stop(loop_timer* t)
+{
+#if defined(AS_USE_LIBUV)
+	uv_timer_stop(&t->timer);
+#elif defined(AS_USE_LIBEVENT)
+	event_del(t->timer);
+#else
+	ev_timer_stop(t->loop, &t->timer);
+#endif
+}
+
+void
+loop_timer_close(loop_timer* t)
+{
+#if defined(AS_USE_LIBUV)
+	uv_timer_stop(&t->timer);
+	uv_close((uv_handle_t*)&t->timer, NULL);
+#elif defined(AS_USE_LIBEVENT)
+	event_free(t->timer);
+#else
+	ev_timer_stop(t->loop, &t->timer);
+#endif
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <aerospike/as_event.h>
+
+#if defined(AS_USE_LIBEVENT)
+#include <event2/event.h>
+#endif
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+typedef void (*loop_timer_callback)(void* udata);
+
+// Timer that runs on an event loop, for whichever event library the client
+// was built with. All functions must be called from the event loop's thread.
+typedef struct {
+#if defined(AS_USE_LIBUV)
+	uv_timer_t timer;
+#elif defined(AS_USE_LIBEVENT)
+	struct event* timer;
+#else
+	ev_timer timer;
+	struct ev_loop* loop;
+#endif
+	loop_timer_callback callback;
+	void* udata;
+} loop_timer;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void loop_timer_init(loop_timer* t, as_event_loop* event_loop, loop_timer_callback callback, void* udata);
+
+// Fire after delay_us microseconds, then every repeat_us microseconds if
+// repeat_us is non-zero. Restarting an active timer resets it. With libevent,
+// a repeating timer's first expiry also uses repeat_us.
+void loop_timer_start(loop_timer* t, uint64_t delay_us, uint64_t repeat_us);
+
+void loop_timer_stop(loop_timer* t);
+
+// Stop timer and release event library resources. Timer memory must remain
+// valid until the event loop has run once more (libuv close is deferred).
+void loop_timer_close(loop_timer* t);
@@ -0,0 +1,1076 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include <time.h>
+#include <unistd.h>
+
+// Local stand-in for an Aerospike server node. It speaks enough of the wire
+// protocol for the C client to connect and tend (info, peers, partition map)
+// and to run put, get and batch read commands. Records are kept in memory and
+// every write replaces all bins of a record. Responses can be delayed, jittered
+// and replaced by errors, so client-side overhead can be measured separately
+// from server behavior.
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+#define PROTO_VERSION 2
+#define PROTO_TYPE_INFO 1
+#define PROTO_TYPE_MSG 3
+#define MSG_HEADER_SIZE 22
+#define DIGEST_SIZE 20
+#define N_PARTITIONS 4096
+#define MAX_CONNS 4096
+#define MAX_PROTO_SIZE (128 * 1024 * 1024)
+
+#define INFO1_READ 1
+#define INFO1_GET_ALL 2
+#define INFO1_BATCH 8
+#define INFO1_NOBINDATA 32
+#define INFO2_WRITE 1
+#define INFO2_DELETE 2
+#define INFO3_LAST 1
+
+#define FIELD_NAMESPACE 0
+#define FIELD_DIGEST 4
+#define FIELD_BATCH_INDEX 41
+#define FIELD_BATCH_INDEX_WITH_SET 42
+
+#define OP_READ 1
+#define OP_WRITE 2
+
+#define RESULT_OK 0
+#define RESULT_NOT_FOUND 2
+#define RESULT_PARAMETER 4
+
+typedef struct {
+	uint8_t digest[DIGEST_SIZE];
+	bool used;            // Slot has held a record.
+	bool exists;          // Record has not been deleted.
+	uint32_t generation;
+	uint16_t n_bins;
+	uint32_t size;
+	uint8_t* bins;        // Serialized read ops, ready to send.
+} record;
+
+typedef struct {
+	record* slots;
+	uint32_t capacity;
+	uint32_t used;
+} record_table;
+
+// Response waiting for its delay to expire. Responses on one connection are
+// always sent in request order, which pipelined clients rely on.
+typedef struct response_s {
+	struct response_s* next;
+	uint64_t due;
+	uint32_t size;
+	uint8_t data[];
+} response;
+
+typedef struct {
+	int fd;
+	uint8_t* in;
+	uint32_t in_size;
+	uint32_t in_capacity;
+	response* head;       // Pending responses, oldest first.
+	response* tail;
+	uint32_t out_offset;  // Bytes of head already written.
+	uint64_t last_due;
+} conn;
+
+typedef struct {
+	uint8_t* data;
+	uint32_t size;
+	uint32_t capacity;
+} buffer;
+
+/******************************************************************************
+ *	Globals
+ *****************************************************************************/
+
+static int g_port = 3000;
+static const char* g_namespace = "test";
+static const char* g_node_name = "BB9000000000001";
+static uint64_t g_delay = 0;         // Microseconds.
+static uint64_t g_jitter = 0;        // Microseconds.
+static uint32_t g_error_rate = 0;    // Errors per million requests.
+static uint8_t g_error_code = 9;     // AEROSPIKE_ERR_TIMEOUT.
+static bool g_verbose = false;
+
+static record_table g_records;
+static conn g_conns[MAX_CONNS];
+static struct pollfd g_pollfds[MAX_CONNS + 1];
+static uint32_t g_conn_count = 0;
+static uint64_t g_seed = 0x9E3779B97F4A7C15ULL;
+static char* g_replicas;             // Base64 partition bitmap.
+
+static volatile sig_atomic_t g_stop = 0;
+
+static uint64_t g_requests = 0;
+static uint64_t g_errors = 0;
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t
+random_next(void)
+{
+	uint64_t x = g_seed;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	g_seed = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static bool
+inject_error(void)
+{
+	return g_error_rate && random_next() % 1000000 < g_error_rate;
+}
+
+static inline uint16_t
+get_be16(const uint8_t* p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t
+get_be32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void
+put_be16(uint8_t* p, uint16_t v)
+{
+	p[0] = (uint8_t)(v >> 8);
+	p[1] = (uint8_t)v;
+}
+
+static inline void
+put_be32(uint8_t* p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static void
+buffer_reserve(buffer* b, uint32_t size)
+{
+	if (b->size + size > b->capacity) {
+		uint32_t capacity = b->capacity ? b->capacity : 256;
+
+		while (capacity < b->size + size) {
+			capacity *= 2;
+		}
+		b->data = realloc(b->data, capacity);
+		b->capacity = capacity;
+	}
+}
+
+static void
+buffer_append(buffer* b, const void* data, uint32_t size)
+{
+	buffer_reserve(b, size);
+	memcpy(b->data + b->size, data, size);
+	b->size += size;
+}
+
+static void
+buffer_append_str(buffer* b, const char* str)
+{
+	buffer_append(b, str, (uint32_t)strlen(str));
+}
+
+static void
+write_proto_header(uint8_t* p, uint8_t type, uint64_t size)
+{
+	uint64_t proto = ((uint64_t)PROTO_VERSION << 56) | ((uint64_t)type << 48) | size;
+
+	for (int i = 7; i >= 0; i--) {
+		p[i] = (uint8_t)proto;
+		proto >>= 8;
+	}
+}
+
+static void
+append_msg_header(buffer* b, uint8_t info3, uint8_t result_code, uint32_t generation,
+	uint32_t batch_index, uint16_t n_ops)
+{
+	uint8_t h[MSG_HEADER_SIZE];
+	memset(h, 0, sizeof(h));
+	h[0] = MSG_HEADER_SIZE;
+	h[3] = info3;
+	h[5] = result_code;
+	put_be32(h + 6, generation);
+	put_be32(h + 10, 0);            // Record void time. Never expires.
+	put_be32(h + 14, batch_index);  // Transaction ttl slot carries batch index.
+	put_be16(h + 18, 0);            // Fields.
+	put_be16(h + 20, n_ops);
+	buffer_append(b, h, sizeof(h));
+}
+
+/******************************************************************************
+ *	Record Table
+ *****************************************************************************/
+
+static record*
+record_find(const uint8_t* digest, bool create)
+{
+	record_table* t = &g_records;
+
+	if (create && (t->used + 1) * 10 > t->capacity * 7) {
+		// Grow table.
+		record* old = t->slots;
+		uint32_t old_capacity = t->capacity;
+
+		t->capacity = old_capacity ? old_capacity * 2 : 1024;
+		t->slots = calloc(t->capacity, sizeof(record));
+
+		for (uint32_t i = 0; i < old_capacity; i++) {
+			if (old[i].used) {
+				uint64_t h;
+				memcpy(&h, old[i].digest, sizeof(h));
+				uint32_t j = (uint32_t)h & (t->capacity - 1);
+
+				while (t->slots[j].used) {
+					j = (j + 1) & (t->capacity - 1);
+				}
+				t->slots[j] = old[i];
+			}
+		}
+		free(old);
+	}
+
+	if (t->capacity == 0) {
+		return NULL;
+	}
+
+	// Digests are already uniformly distributed.
+	uint64_t h;
+	memcpy(&h, digest, sizeof(h));
+	uint32_t i = (uint32_t)h & (t->capacity - 1);
+
+	while (t->slots[i].used) {
+		if (memcmp(t->slots[i].digest, digest, DIGEST_SIZE) == 0) {
+			return &t->slots[i];
+		}
+		i = (i + 1) & (t->capacity - 1);
+	}
+
+	if (! create) {
+		return NULL;
+	}
+
+	record* rec = &t->slots[i];
+	memcpy(rec->digest, digest, DIGEST_SIZE);
+	rec->used = true;
+	t->used++;
+	return rec;
+}
+
+/******************************************************************************
+ *	Info
+ *****************************************************************************/
+
+static void
+init_replicas(void)
+{
+	// Every partition is owned by this node.
+	static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint8_t bitmap[N_PARTITIONS / 8];
+	uint32_t size = sizeof(bitmap);
+
+	memset(bitmap, 0xFF, size);
+	g_replicas = malloc((size + 2) / 3 * 4 + 1);
+
+	char* p = g_replicas;
+
+	for (uint32_t i = 0; i < size; i += 3) {
+		uint32_t v = bitmap[i] << 16;
+
+		if (i + 1 < size) {
+			v |= bitmap[i + 1] << 8;
+		}
+
+		if (i + 2 < size) {
+			v |= bitmap[i + 2];
+		}
+
+		*p++ = b64[(v >> 18) & 63];
+		*p++ = b64[(v >> 12) & 63];
+		*p++ = i + 1 < size ? b64[(v >> 6) & 63] : '=';
+		*p++ = i + 2 < size ? b64[v & 63] : '=';
+	}
+	*p = 0;
+}
+
+static void
+info_value(buffer* b, const char* name)
+{
+	char tmp[256];
+
+	if (strcmp(name, "node") == 0) {
+		buffer_append_str(b, g_node_name);
+	}
+	else if (strcmp(name, "features") == 0) {
+		// Deliberately omit newer batch protocols, so clients fall back to
+		// the batch index format handled below.
+		buffer_append_str(b, "peers;pipelining;replicas;replicas-all;replicas-master");
+	}
+	else if (strcmp(name, "partitions") == 0) {
+		snprintf(tmp, sizeof(tmp), "%d", N_PARTITIONS);
+		buffer_append_str(b, tmp);
+	}
+	else if (strcmp(name, "partition-generation") == 0 ||
+			 strcmp(name, "peers-generation") == 0 ||
+			 strcmp(name, "rebalance-generation") == 0) {
+		buffer_append_str(b, "1");
+	}
+	else if (strncmp(name, "peers-", 6) == 0) {
+		// No other nodes: <generation>,<default port>,[]
+		snprintf(tmp, sizeof(tmp), "1,%d,[]", g_port);
+		buffer_append_str(b, tmp);
+	}
+	else if (strcmp(name, "replicas") == 0) {
+		// <namespace>:<regime>,<replica count>,<bitmap>;
+		snprintf(tmp, sizeof(tmp), "%s:0,1,", g_namespace);
+		buffer_append_str(b, tmp);
+		buffer_append_str(b, g_replicas);
+	}
+	else if (strcmp(name, "replicas-all") == 0) {
+		snprintf(tmp, sizeof(tmp), "%s:1,", g_namespace);
+		buffer_append_str(b, tmp);
+		buffer_append_str(b, g_replicas);
+	}
+	else if (strcmp(name, "replicas-master") == 0) {
+		snprintf(tmp, sizeof(tmp), "%s:", g_namespace);
+		buffer_append_str(b, tmp);
+		buffer_append_str(b, g_replicas);
+	}
+	else if (strcmp(name, "build") == 0 || strcmp(name, "version") == 0) {
+		buffer_append_str(b, "4.9.0.0");
+	}
+	else if (strcmp(name, "cluster-name") == 0) {
+		buffer_append_str(b, "null");
+	}
+	else if (strcmp(name, "namespaces") == 0) {
+		buffer_append_str(b, g_namespace);
+	}
+	else if (strncmp(name, "racks:", 6) == 0) {
+		snprintf(tmp, sizeof(tmp), "ns=%s:rack_0=%s", g_namespace, g_node_name);
+		buffer_append_str(b, tmp);
+	}
+	// Unknown names get an empty value.
+}
+
+static void
+handle_info(buffer* b, const uint8_t* body, uint64_t size)
+{
+	// Request: name1\nname2\n  Response: name1\tvalue1\nname2\tvalue2\n
+	char names[4096];
+	uint64_t len = size < sizeof(names) - 1 ? size : sizeof(names) - 1;
+
+	memcpy(names, body, len);
+	names[len] = 0;
+
+	buffer_reserve(b, 8);
+	b->size += 8;
+
+	char* save = NULL;
+
+	for (char* name = strtok_r(names, "\n", &save); name; name = strtok_r(NULL, "\n", &save)) {
+		buffer_append_str(b, name);
+		buffer_append_str(b, "\t");
+		info_value(b, name);
+		buffer_append_str(b, "\n");
+	}
+	write_proto_header(b->data, PROTO_TYPE_INFO, b->size - 8);
+}
+
+/******************************************************************************
+ *	Commands
+ *****************************************************************************/
+
+// Append record bins, optionally filtered by the read ops in the request.
+static uint16_t
+append_bins(buffer* b, const record* rec, const uint8_t* ops, uint16_t n_ops, bool all)
+{
+	if (all || n_ops == 0) {
+		buffer_append(b, rec->bins, rec->size);
+		return rec->n_bins;
+	}
+
+	uint16_t count = 0;
+
+	for (uint16_t i = 0; i < n_ops; i++) {
+		uint32_t op_size = get_be32(ops);
+		uint8_t name_size = ops[7];
+		const uint8_t* name = ops + 8;
+		const uint8_t* p = rec->bins;
+
+		for (uint16_t j = 0; j < rec->n_bins; j++) {
+			uint32_t bin_size = get_be32(p);
+
+			if (p[7] == name_size && memcmp(p + 8, name, name_size) == 0) {
+				buffer_append(b, p, bin_size + 4);
+				count++;
+				break;
+			}
+			p += bin_size + 4;
+		}
+		ops += op_size + 4;
+	}
+	return count;
+}
+
+static void
+handle_write(buffer* b, const uint8_t* digest, uint8_t info2, const uint8_t* ops, uint16_t n_ops, const uint8_t* end)
+{
+	// Ops have been checked by skip_ops(), so they fit between ops and end.
+	record* rec = record_find(digest, ! (info2 & INFO2_DELETE));
+
+	if (info2 & INFO2_DELETE) {
+		bool found = rec && rec->exists;
+
+		if (found) {
+			free(rec->bins);
+			rec->bins = NULL;
+			rec->size = 0;
+			rec->n_bins = 0;
+			rec->exists = false;
+		}
+		append_msg_header(b, 0, found ? RESULT_OK : RESULT_NOT_FOUND, 0, 0, 0);
+		return;
+	}
+
+	// Store write ops as read ops, so reads can send them back unchanged.
+	free(rec->bins);
+	rec->bins = malloc(end - ops > 0 ? end - ops : 1);
+	rec->size = 0;
+	rec->n_bins = 0;
+
+	const uint8_t* p = ops;
+
+	for (uint16_t i = 0; i < n_ops; i++) {
+		uint32_t op_size = get_be32(p);
+
+		if (p[4] == OP_WRITE) {
+			memcpy(rec->bins + rec->size, p, op_size + 4);
+			rec->bins[rec->size + 4] = OP_READ;
+			rec->size += op_size + 4;
+			rec->n_bins++;
+		}
+		p += op_size + 4;
+	}
+
+	rec->exists = true;
+	rec->generation++;
+	append_msg_header(b, 0, RESULT_OK, rec->generation, 0, 0);
+}
+
+static void
+handle_read(buffer* b, const uint8_t* digest, uint8_t info1, const uint8_t* ops, uint16_t n_ops, uint32_t batch_index)
+{
+	record* rec = record_find(digest, false);
+
+	if (! rec || ! rec->exists) {
+		append_msg_header(b, 0, RESULT_NOT_FOUND, 0, batch_index, 0);
+		return;
+	}
+
+	if (info1 & INFO1_NOBINDATA) {
+		append_msg_header(b, 0, RESULT_OK, rec->generation, batch_index, 0);
+		return;
+	}
+
+	// Reserve header, then fill in bin count.
+	uint32_t offset = b->size;
+	append_msg_header(b, 0, RESULT_OK, rec->generation, batch_index, 0);
+
+	uint16_t count = append_bins(b, rec, ops, n_ops, info1 & INFO1_GET_ALL);
+	put_be16(b->data + offset + 20, count);
+}
+
+// Lengths come off the wire, so every one is checked against end before it
+// is used. Returns NULL if a field runs past end.
+static const uint8_t*
+skip_fields(const uint8_t* p, uint16_t n_fields, const uint8_t* end)
+{
+	// Field: <size:4><type:1><data>. Size includes the type.
+	for (uint16_t i = 0; i < n_fields; i++) {
+		if (end - p < 5) {
+			return NULL;
+		}
+
+		uint32_t size = get_be32(p);
+
+		if (size == 0 || size > (uint64_t)(end - p - 4)) {
+			return NULL;
+		}
+		p += size + 4;
+	}
+	return p;
+}
+
+// Returns NULL if an op runs past end or its name runs past the op.
+static const uint8_t*
+skip_ops(const uint8_t* p, uint16_t n_ops, const uint8_t* end)
+{
+	// Op: <size:4><op:1><particle type:1><version:1><name size:1><name><value>.
+	for (uint16_t i = 0; i < n_ops; i++) {
+		if (end - p < 8) {
+			return NULL;
+		}
+
+		uint32_t size = get_be32(p);
+
+		if (size < 4 || size > (uint64_t)(end - p - 4) || p[7] > size - 4) {
+			return NULL;
+		}
+		p += size + 4;
+	}
+	return p;
+}
+
+// Returns false if the request is malformed.
+static bool
+handle_batch(buffer* b, const uint8_t* field, uint32_t field_size)
+{
+	// Batch index: <count:4><flags:1> then per key
+	// <index:4><digest:20><repeat:1>[<info1:1><n_fields:2><n_ops:2><fields><ops>]
+	const uint8_t* p = field;
+	const uint8_t* end = field + field_size;
+	uint8_t info1 = INFO1_READ | INFO1_GET_ALL;
+	const uint8_t* ops = NULL;
+	uint16_t n_ops = 0;
+
+	if (field_size < 5) {
+		return false;
+	}
+
+	uint32_t count = get_be32(p);
+
+	p += 5;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (end - p < 25) {
+			return false;
+		}
+
+		uint32_t index = get_be32(p);
+		const uint8_t* digest = p + 4;
+		uint8_t repeat = p[24];
+
+		p += 25;
+
+		if (! repeat) {
+			uint16_t n_fields;
+
+			if (end - p < 5) {
+				return false;
+			}
+
+			info1 = p[0];
+			n_fields = get_be16(p + 1);
+			n_ops = get_be16(p + 3);
+			ops = skip_fields(p + 5, n_fields, end);
+
+			if (! ops) {
+				return false;
+			}
+
+			p = skip_ops(ops, n_ops, end);
+
+			if (! p) {
+				return false;
+			}
+		}
+
+		g_requests++;
+
+		if (inject_error()) {
+			g_errors++;
+			append_msg_header(b, 0, g_error_code, 0, index, 0);
+			continue;
+		}
+		handle_read(b, digest, info1, ops, n_ops, index);
+	}
+
+	// Terminating message.
+	append_msg_header(b, INFO3_LAST, RESULT_OK, 0, 0, 0);
+	return true;
+}
+
+// Returns false if the request is malformed and the connection should be
+// dropped.
+static bool
+handle_msg(buffer* b, const uint8_t* body, uint64_t size)
+{
+	buffer_reserve(b, 8);
+	b->size += 8;
+
+	if (size < MSG_HEADER_SIZE || body[0] != MSG_HEADER_SIZE) {
+		append_msg_header(b, 0, RESULT_PARAMETER, 0, 0, 0);
+		write_proto_header(b->data, PROTO_TYPE_MSG, b->size - 8);
+		return true;
+	}
+
+	const uint8_t* end = body + size;
+	uint8_t info1 = body[1];
+	uint8_t info2 = body[2];
+	uint16_t n_fields = get_be16(body + 18);
+	uint16_t n_ops = get_be16(body + 20);
+	const uint8_t* p = body + MSG_HEADER_SIZE;
+	const uint8_t* digest = NULL;
+	const uint8_t* batch = NULL;
+	uint32_t batch_size = 0;
+	const uint8_t* ops = skip_fields(p, n_fields, end);
+
+	if (! ops || ! skip_ops(ops, n_ops, end)) {
+		return false;
+	}
+
+	// Fields are known to fit.
+	for (uint16_t i = 0; i < n_fields; i++) {
+		uint32_t field_size = get_be32(p);
+		uint8_t type = p[4];
+
+		if (type == FIELD_DIGEST && field_size - 1 == DIGEST_SIZE) {
+			digest = p + 5;
+		}
+		else if (type == FIELD_BATCH_INDEX || type == FIELD_BATCH_INDEX_WITH_SET) {
+			batch = p + 5;
+			batch_size = field_size - 1;
+		}
+		p += field_size + 4;
+	}
+
+	if (batch) {
+		if (! handle_batch(b, batch, batch_size)) {
+			return false;
+		}
+	}
+	else if (! digest) {
+		append_msg_header(b, 0, RESULT_PARAMETER, 0, 0, 0);
+	}
+	else {
+		g_requests++;
+
+		if (inject_error()) {
+			g_errors++;
+			append_msg_header(b, 0, g_error_code, 0, 0, 0);
+		}
+		else if (info2 & INFO2_WRITE) {
+			handle_write(b, digest, info2, ops, n_ops, end);
+		}
+		else if (info1 & INFO1_READ) {
+			handle_read(b, digest, info1, ops, n_ops, 0);
+		}
+		else {
+			append_msg_header(b, 0, RESULT_OK, 0, 0, 0);
+		}
+	}
+	write_proto_header(b->data, PROTO_TYPE_MSG, b->size - 8);
+	return true;
+}
+
+/******************************************************************************
+ *	Connections
+ *****************************************************************************/
+
+static void
+queue_response(conn* c, buffer* b)
+{
+	uint64_t due = now_us() + g_delay;
+
+	if (g_jitter) {
+		due += random_next() % (g_jitter + 1);
+	}
+
+	// Keep responses in request order.
+	if (due < c->last_due) {
+		due = c->last_due;
+	}
+	c->last_due = due;
+
+	response* r = malloc(sizeof(response) + b->size);
+	r->next = NULL;
+	r->due = due;
+	r->size = b->size;
+	memcpy(r->data, b->data, b->size);
+
+	if (c->tail) {
+		c->tail->next = r;
+	}
+	else {
+		c->head = r;
+	}
+	c->tail = r;
+}
+
+static bool
+process_input(conn* c)
+{
+	uint32_t offset = 0;
+	buffer b = {0};
+
+	while (c->in_size - offset >= 8) {
+		const uint8_t* p = c->in + offset;
+		uint8_t type = p[1];
+		uint64_t size = 0;
+
+		for (int i = 2; i < 8; i++) {
+			size = (size << 8) | p[i];
+		}
+
+		if (size > MAX_PROTO_SIZE) {
+			free(b.data);
+			return false;
+		}
+
+		if (c->in_size - offset < 8 + size) {
+			break;
+		}
+
+		b.size = 0;
+
+		if (type == PROTO_TYPE_INFO) {
+			handle_info(&b, p + 8, size);
+		}
+		else if (type == PROTO_TYPE_MSG) {
+			if (! handle_msg(&b, p + 8, size)) {
+				free(b.data);
+				return false;
+			}
+		}
+		else {
+			// Compressed and admin messages are not supported.
+			free(b.data);
+			return false;
+		}
+
+		queue_response(c, &b);
+		offset += 8 + (uint32_t)size;
+	}
+	free(b.data);
+
+	memmove(c->in, c->in + offset, c->in_size - offset);
+	c->in_size -= offset;
+	return true;
+}
+
+static bool
+read_conn(conn* c)
+{
+	while (true) {
+		if (c->in_capacity - c->in_size < 65536) {
+			c->in_capacity = c->in_capacity ? c->in_capacity * 2 : 131072;
+			c->in = realloc(c->in, c->in_capacity);
+		}
+
+		ssize_t n = read(c->fd, c->in + c->in_size, c->in_capacity - c->in_size);
+
+		if (n > 0) {
+			c->in_size += (uint32_t)n;
+			continue;
+		}
+
+		if (n == 0) {
+			return false;
+		}
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			break;
+		}
+
+		if (errno != EINTR) {
+			return false;
+		}
+	}
+	return process_input(c);
+}
+
+static bool
+write_conn(conn* c, uint64_t now)
+{
+	while (c->head && c->head->due <= now) {
+		response* r = c->head;
+		ssize_t n = write(c->fd, r->data + c->out_offset, r->size - c->out_offset);
+
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return true;
+			}
+			return errno == EINTR;
+		}
+
+		c->out_offset += (uint32_t)n;
+
+		if (c->out_offset < r->size) {
+			return true;
+		}
+
+		c->out_offset = 0;
+		c->head = r->next;
+
+		if (! c->head) {
+			c->tail = NULL;
+		}
+		free(r);
+	}
+	return true;
+}
+
+static void
+close_conn(uint32_t i)
+{
+	conn* c = &g_conns[i];
+
+	close(c->fd);
+	free(c->in);
+
+	while (c->head) {
+		response* r = c->head;
+		c->head = r->next;
+		free(r);
+	}
+
+	// Move last connection into this slot.
+	g_conn_count--;
+	g_conns[i] = g_conns[g_conn_count];
+}
+
+static void
+accept_conns(int listen_fd)
+{
+	while (true) {
+		int fd = accept(listen_fd, NULL, NULL);
+
+		if (fd < 0) {
+			return;
+		}
+
+		if (g_conn_count == MAX_CONNS) {
+			close(fd);
+			continue;
+		}
+
+		int flag = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+		conn* c = &g_conns[g_conn_count++];
+		memset(c, 0, sizeof(conn));
+		c->fd = fd;
+	}
+}
+
+static int
+wait_events(uint32_t count, uint64_t next_due, uint64_t now)
+{
+	// Sleep until an event or the next delayed response is due. Delays are in
+	// microseconds, so the wait must not round up to poll()'s milliseconds.
+	if (next_due == UINT64_MAX) {
+		return poll(g_pollfds, count, -1);
+	}
+
+	uint64_t wait = next_due > now ? next_due - now : 0;
+
+#ifdef __linux__
+	struct timespec ts = {.tv_sec = wait / 1000000, .tv_nsec = (wait % 1000000) * 1000};
+	return ppoll(g_pollfds, count, &ts, NULL);
+#else
+	// No ppoll(). Round down and spin the last partial millisecond through
+	// zero timeout polls, which keeps sub-millisecond delays accurate.
+	return poll(g_pollfds, count, (int)(wait / 1000));
+#endif
+}
+
+static void
+stop_server(int sig)
+{
+	(void)sig;
+	g_stop = 1;
+}
+
+static void
+print_usage(const char* program)
+{
+	printf("Usage: %s [-p <port>] [-n <namespace>] [-d <delay>] [-j <jitter>] [-e <error rate>] [-E <code>] [-v]\n", program);
+	printf("-p: listen port (default 3000)\n");
+	printf("-n: namespace in partition map (default test)\n");
+	printf("-d: delay every response by <microseconds> (default 0)\n");
+	printf("-j: add uniform random jitter up to <microseconds> (default 0)\n");
+	printf("-e: fail <percent> of record requests, e.g. 0.1 (default 0)\n");
+	printf("-E: result code for injected failures (default 9, timeout)\n");
+	printf("-v: print request counts on exit\n");
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+int
+main(int argc, char* argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "p:n:d:j:e:E:v")) != -1) {
+		switch (c) {
+			case 'p':
+				g_port = atoi(optarg);
+				break;
+			case 'n':
+				g_namespace = optarg;
+				break;
+			case 'd':
+				g_delay = strtoull(optarg, NULL, 10);
+				break;
+			case 'j':
+				g_jitter = strtoull(optarg, NULL, 10);
+				break;
+			case 'e':
+				g_error_rate = (uint32_t)(strtod(optarg, NULL) * 10000);
+				break;
+			case 'E':
+				g_error_code = (uint8_t)atoi(optarg);
+				break;
+			case 'v':
+				g_verbose = true;
+				break;
+			default:
+				print_usage(argv[0]);
+				return 0;
+		}
+	}
+
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	int flag = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(g_port);
+
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 1024) != 0) {
+		printf("Failed to listen on port %d: %s\n", g_port, strerror(errno));
+		return -1;
+	}
+	fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+	signal(SIGINT, stop_server);
+	signal(SIGTERM, stop_server);
+	signal(SIGPIPE, SIG_IGN);
+	init_replicas();
+
+#ifdef __linux__
+	// Default 50us timer slack would be added to every delayed response.
+	prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+#endif
+
+	printf("Mock server listening on 127.0.0.1:%d namespace=%s delay=%lluus jitter=%lluus errors=%.4f%% code=%u\n",
+		g_port, g_namespace, (unsigned long long)g_delay, (unsigned long long)g_jitter,
+		g_error_rate / 10000.0, g_error_code);
+	fflush(stdout);
+
+	while (! g_stop) {
+		uint64_t now = now_us();
+		uint64_t next_due = UINT64_MAX;
+
+		g_pollfds[0].fd = listen_fd;
+		g_pollfds[0].events = POLLIN;
+
+		for (uint32_t i = 0; i < g_conn_count; i++) {
+			conn* c = &g_conns[i];
+
+			g_pollfds[i + 1].fd = c->fd;
+			g_pollfds[i + 1].events = POLLIN;
+
+			if (c->head) {
+				if (c->head->due <= now) {
+					g_pollfds[i + 1].events |= POLLOUT;
+				}
+				else if (c->head->due < next_due) {
+					next_due = c->head->due;
+				}
+			}
+		}
+
+		int rv = wait_events(g_conn_count + 1, next_due, now);
+
+		if (rv < 0 && errno != EINTR) {
+			break;
+		}
+
+		now = now_us();
+
+		// Walk backwards, since closing moves the last connection into the
+		// closed slot.
+		for (uint32_t i = g_conn_count; i > 0; i--) {
+			conn* c = &g_conns[i - 1];
+			short revents = g_pollfds[i].revents;
+			bool ok = true;
+
+			if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				ok = false;
+			}
+			else if (revents & POLLIN) {
+				ok = read_conn(c);
+			}
+
+			if (ok) {
+				ok = write_conn(c, now);
+			}
+
+			if (! ok) {
+				close_conn(i - 1);
+				// Connection moved into this slot has already been handled.
+			}
+		}
+
+		if (g_pollfds[0].revents & POLLIN) {
+			accept_conns(listen_fd);
+		}
+	}
+
+	if (g_verbose) {
+		printf("Requests=%llu InjectedErrors=%llu Records=%u\n",
+			(unsigned long long)g_requests, (unsigned long long)g_errors, g_records.used);
+	}
+
+	for (uint32_t i = g_conn_count; i > 0; i--) {
+		close_conn(i - 1);
+	}
+	close(listen_fd);
+	return 0;
+}
@@ -0,0 +1,198 @@
+#include "retry.h"
+#include <stdlib.h>
+#include "distribution.h"
+#include "histogram.h"
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static inline void
+heap_set(retry_queue* q, uint32_t i, retry_entry* e)
+{
+	q->heap[i] = e;
+	e->index = i + 1;
+}
+
+static void
+sift_up(retry_queue* q, uint32_t i)
+{
+	retry_entry* e = q->heap[i];
+
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (q->heap[parent]->due <= e->due) {
+			break;
+		}
+		heap_set(q, i, q->heap[parent]);
+		i = parent;
+	}
+	heap_set(q, i, e);
+}
+
+static void
+sift_down(retry_queue* q, uint32_t i)
+{
+	retry_entry* e = q->heap[i];
+
+	while (true) {
+		uint32_t child = i * 2 + 1;
+
+		if (child >= q->size) {
+			break;
+		}
+
+		if (child + 1 < q->size && q->heap[child + 1]->due < q->heap[child]->due) {
+			child++;
+		}
+
+		if (e->due <= q->heap[child]->due) {
+			break;
+		}
+		heap_set(q, i, q->heap[child]);
+		i = child;
+	}
+	heap_set(q, i, e);
+}
+
+static void
+arm(retry_queue* q, uint64_t now)
+{
+	if (q->size == 0) {
+		if (q->armed) {
+			q->armed = 0;
+			loop_timer_stop(&q->timer);
+		}
+		return;
+	}
+
+	uint64_t due = q->heap[0]->due;
+
+	if (due == q->armed) {
+		return;
+	}
+
+	q->armed = due;
+	loop_timer_start(&q->timer, due > now ? (due - now + 999) / 1000 : 0, 0);
+}
+
+static void
+queue_fired(void* udata)
+{
+	retry_queue* q = udata;
+	uint64_t now = histogram_now();
+
+	q->armed = 0;
+
+	// Callbacks may queue new entries. Those are due later than now, so this
+	// loop still ends.
+	while (q->size > 0 && q->heap[0]->due <= now) {
+		retry_entry* e = q->heap[0];
+
+		retry_queue_remove(q, e);
+		e->callback(e->udata);
+	}
+	arm(q, now);
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void
+retry_queue_init(retry_queue* q, as_event_loop* event_loop)
+{
+	q->heap = NULL;
+	q->size = 0;
+	q->capacity = 0;
+	q->armed = 0;
+	loop_timer_init(&q->timer, event_loop, queue_fired, q);
+}
+
+void
+retry_queue_close(retry_queue* q)
+{
+	for (uint32_t i = 0; i < q->size; i++) {
+		q->heap[i]->index = 0;
+	}
+	loop_timer_close(&q->timer);
+	free(q->heap);
+	q->heap = NULL;
+	q->size = 0;
+}
+
+void
+retry_queue_add(retry_queue* q, retry_entry* e, uint64_t due, retry_callback callback, void* udata)
+{
+	if (q->size == q->capacity) {
+		q->capacity = q->capacity ? q->capacity * 2 : 64;
+		q->heap = realloc(q->heap, sizeof(retry_entry*) * q->capacity);
+	}
+
+	e->due = due;
+	e->callback = callback;
+	e->udata = udata;
+	q->heap[q->size++] = e;
+	sift_up(q, q->size - 1);
+
+	if (e->index == 1) {
+		// New earliest entry.
+		arm(q, histogram_now());
+	}
+}
+
+void
+retry_queue_remove(retry_queue* q, retry_entry* e)
+{
+	if (e->index == 0) {
+		return;
+	}
+
+	uint32_t i = e->index - 1;
+	retry_entry* last = q->heap[--q->size];
+
+	e->index = 0;
+
+	if (last != e) {
+		// Fill the hole with the last entry, then restore heap order.
+		heap_set(q, i, last);
+
+		if (i > 0 && q->heap[(i - 1) / 2]->due > last->due) {
+			sift_up(q, i);
+		}
+		else {
+			sift_down(q, i);
+		}
+	}
+
+	// An early timer for a removed entry is harmless, it just finds nothing due.
+}
+
+bool
+retry_error_retryable(as_status code)
+{
+	switch (code) {
+		case AEROSPIKE_ERR_TIMEOUT:
+		case AEROSPIKE_ERR_DEVICE_OVERLOAD:
+		case AEROSPIKE_ERR_RECORD_BUSY:
+		case AEROSPIKE_NO_MORE_CONNECTIONS:
+		case AEROSPIKE_ERR_CONNECTION:
+		case AEROSPIKE_ERR_ASYNC_CONNECTION:
+		case AEROSPIKE_ERR_CLUSTER:
+			return true;
+		default:
+			return false;
+	}
+}
+
+uint64_t
+retry_backoff(uint32_t attempt, uint64_t base, uint64_t max, uint64_t* seed)
+{
+	uint64_t cap = attempt < 32 ? base << attempt : max;
+
+	if (cap > max || cap < base) {
+		cap = max;
+	}
+	return (uint64_t)(random_next_double(seed) * cap);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <aerospike/as_event.h>
+#include <aerospike/as_status.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "loop_timer.h"
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+typedef void (*retry_callback)(void* udata);
+
+// Delayed callback, embedded in the command or batch chunk it belongs to.
+// Zeroed memory is a valid entry that is not queued.
+typedef struct {
+	uint64_t due;      // Monotonic time in nanoseconds.
+	uint32_t index;    // Heap position plus one, or 0 when not queued.
+	retry_callback callback;
+	void* udata;
+} retry_entry;
+
+// Min-heap of delayed callbacks driven by a single one-shot loop timer, so
+// any number of commands can back off without a timer each. Owned by one
+// event loop, and all functions must be called from its thread.
+typedef struct {
+	loop_timer timer;
+	retry_entry** heap;
+	uint32_t size;
+	uint32_t capacity;
+	uint64_t armed;    // Due time the timer is set for, or 0 if idle.
+} retry_queue;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void retry_queue_init(retry_queue* q, as_event_loop* event_loop);
+
+// Close timer and free heap. Queued entries are dropped.
+void retry_queue_close(retry_queue* q);
+
+// Run callback at due. The entry must not already be queued.
+void retry_queue_add(retry_queue* q, retry_entry* e, uint64_t due, retry_callback callback, void* udata);
+
+// Remove entry if it is queued.
+void retry_queue_remove(retry_queue* q, retry_entry* e);
+
+// Timeouts, overload and connection errors are worth sending again.
+bool retry_error_retryable(as_status code);
+
+// Exponential backoff with full jitter: uniform in [0, min(max, base * 2^attempt)],
+// so retries from many commands spread out instead of arriving together.
+uint64_t retry_backoff(uint32_t attempt, uint64_t base, uint64_t max, uint64_t* seed);
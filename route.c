@@ -0,0 +1,115 @@
+#include "route.h"
+#include <stdlib.h>
+#include <string.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static uint32_t
+partition_loop(route_table* t, uint32_t node, uint32_t partition, uint32_t rank)
+{
+	uint32_t nodes = t->node_count;
+	uint32_t loops = t->loop_count;
+
+	if (node == nodes) {
+		// No known master. Spread these evenly.
+		return partition % loops;
+	}
+
+	if (loops <= nodes) {
+		return node % loops;
+	}
+
+	// Loops node, node + nodes, node + 2 * nodes, ... share this node. Deal
+	// them the node's partitions in turn, by the partition's rank among them.
+	uint32_t share = (loops - node + nodes - 1) / nodes;
+	return node + (rank % share) * nodes;
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+bool
+route_table_init(route_table* t, aerospike* as, const char* ns, uint32_t partition_count, uint32_t loop_count)
+{
+	memset(t, 0, sizeof(route_table));
+
+	as_partition_table* table = as_partition_tables_get(&as->cluster->partition_tables, ns);
+
+	if (! table) {
+		return false;
+	}
+
+	as_nodes* nodes = as_nodes_reserve(as->cluster);
+
+	t->loop_count = loop_count;
+	t->node_count = nodes->size;
+	t->node_names = malloc(sizeof(*t->node_names) * nodes->size);
+	t->partition_count = partition_count;
+	t->partition_node = malloc(sizeof(uint32_t) * partition_count);
+	t->partition_loop = malloc(sizeof(uint32_t) * partition_count);
+
+	uint32_t* ranks = calloc(nodes->size + 1, sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < nodes->size; i++) {
+		memcpy(t->node_names[i], nodes->array[i]->name, AS_NODE_NAME_SIZE);
+	}
+
+	for (uint32_t p = 0; p < partition_count; p++) {
+		as_node* master = p < table->size ? table->partitions[p].nodes[0] : NULL;
+		uint32_t node = nodes->size;
+
+		for (uint32_t i = 0; i < nodes->size; i++) {
+			if (nodes->array[i] == master) {
+				node = i;
+				break;
+			}
+		}
+		t->partition_node[p] = node;
+		t->partition_loop[p] = partition_loop(t, node, p, ranks[node]++);
+	}
+	free(ranks);
+	as_nodes_release(nodes);
+	return true;
+}
+
+void
+route_table_destroy(route_table* t)
+{
+	free(t->node_names);
+	free(t->partition_node);
+	free(t->partition_loop);
+	free(t->keys);
+	free(t->loop_begin);
+}
+
+void
+route_keys_group(route_table* t, const char* ns, const char* set, uint32_t key_count)
+{
+	// Counting sort by loop. The digest is only computed once per key.
+	uint32_t* key_loop = malloc(sizeof(uint32_t) * key_count);
+	uint32_t* next = calloc(t->loop_count, sizeof(uint32_t));
+
+	t->keys = malloc(sizeof(uint32_t) * key_count);
+	t->loop_begin = calloc(t->loop_count + 1, sizeof(uint32_t));
+
+	for (uint32_t k = 0; k < key_count; k++) {
+		as_key key;
+		as_key_init_int64(&key, ns, set, k);
+		key_loop[k] = t->partition_loop[as_partition_getid(as_key_digest(&key)->value, t->partition_count)];
+		t->loop_begin[key_loop[k] + 1]++;
+	}
+
+	for (uint32_t i = 0; i < t->loop_count; i++) {
+		t->loop_begin[i + 1] += t->loop_begin[i];
+		next[i] = t->loop_begin[i];
+	}
+
+	for (uint32_t k = 0; k < key_count; k++) {
+		t->keys[next[key_loop[k]]++] = k;
+	}
+	free(next);
+	free(key_loop);
+}
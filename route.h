@@ -0,0 +1,48 @@
+#pragma once
+
+#include <aerospike/aerospike.h>
+#include <aerospike/as_cluster.h>
+#include <aerospike/as_key.h>
+#include <aerospike/as_partition.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+// Snapshot of the node that masters each partition, and the event loop each
+// partition is routed to. Nodes are dealt to loops round-robin. With more
+// loops than nodes, a node's partitions are split between the loops it was
+// dealt, so a partition still maps to exactly one loop.
+typedef struct {
+	uint32_t loop_count;
+	uint32_t node_count;
+	char (*node_names)[AS_NODE_NAME_SIZE];
+	uint32_t partition_count;
+	uint32_t* partition_node;  // Node index, or node_count if no master is known.
+	uint32_t* partition_loop;
+	uint32_t* keys;            // Keys grouped by loop. route_keys_group() only.
+	uint32_t* loop_begin;      // Start of each loop's keys, loop_count + 1 entries.
+} route_table;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Returns false if the cluster has no partition table for ns.
+bool route_table_init(route_table* t, aerospike* as, const char* ns, uint32_t partition_count, uint32_t loop_count);
+
+void route_table_destroy(route_table* t);
+
+// Group integer keys 0 to key_count - 1 by the loop their partition is
+// routed to. Loop i owns keys[loop_begin[i]] to keys[loop_begin[i + 1] - 1].
+void route_keys_group(route_table* t, const char* ns, const char* set, uint32_t key_count);
+
+// Index of the node that masters key's partition. Computes the key's digest
+// if it has not been yet.
+static inline uint32_t
+route_node(route_table* t, as_key* key)
+{
+	return t->partition_node[as_partition_getid(as_key_digest(key)->value, t->partition_count)];
+}
@@ -4,7 +4,14 @@
 #include <aerospike/as_event.h>
 #include <aerospike/as_monitor.h>
 #include <unistd.h>
-#include <event.h>
+#include "backend.h"
+#include "loop_stats.h"
+
+// Minimal example of one client event loop run on the main thread, for any
+// event library. Only loop creation, run and teardown go through the backend
+// table shared with async_tutorial.c. The write and batch read workload below
+// is deliberately this file's own short copy. Benchmark modes live in
+// async_tutorial.c only.
 
 /******************************************************************************
  *	Types
@@ -13,7 +20,7 @@
 // External loop definition
 typedef struct {
 	pthread_t thread;
-	struct event_base* event_loop;
+	void* native;
 	as_event_loop* as_loop;
 } loop;
 
@@ -36,6 +43,7 @@ static const char* g_namespace = "test";
 static const char* g_set = "test";
 
 static aerospike as;
+static loop_stats g_stats;
 
 /******************************************************************************
  *	Forward Declarations
@@ -79,12 +87,10 @@ main(int argc, char* argv[])
 		}
 	}
 	
+	printf("Backend=%s\n", g_backend.name);
 	printf("Host=%s:%d\n", g_host, g_port);
 	printf("Namespace=%s\n", g_namespace);
 	printf("Set=%s\n", g_set);
-	
-	// Tell client to not call evthread_use_pthreads().
-	as_event_set_single_thread(true);
 
 	// Tell C client the maximum number of event loops that will be shared.
 	if (! as_event_set_external_loop_capacity(1)) {
@@ -92,15 +98,18 @@ main(int argc, char* argv[])
 		return -1;
 	}
 
-	shared_loop.event_loop = event_base_new();
-	shared_loop.as_loop = as_event_set_external_loop(shared_loop.event_loop);
+	shared_loop.native = g_backend.create(true);
+	shared_loop.as_loop = as_event_set_external_loop(shared_loop.native);
+	loop_stats_start(&g_stats, shared_loop.native);
 
 	as_config cfg;
 	as_config_init(&cfg);
 	as_config_add_host(&cfg, g_host, g_port);
 	cfg.async_max_conns_per_node = 100; // Limit number of connections to each node.
 	cfg.thread_pool_size = 0;  // Disable sync command thread pool.
+#if defined(AS_USE_LIBEVENT)
 	cfg.tend_thread_cpu = 0;  // Assign tend thread to cpu core 0.
+#endif
 	aerospike_init(&as, &cfg);
 	
 	// Connect to cluster.
@@ -112,7 +121,7 @@ main(int argc, char* argv[])
 		return -1;
 	}
 
-	as_event_loop_register_aerospike(shared_loop.as_loop, &as);
+	g_backend.register_aerospike(shared_loop.as_loop, &as);
 	
 	// Demonstrate async non-pipelined writes.
 	// Async queue size (100) is less because there is one socket per concurrent command.
@@ -126,8 +135,12 @@ main(int argc, char* argv[])
 	};
 	write_records_async(&counter);
 	
-	event_base_dispatch(shared_loop.event_loop);
-	event_base_free(shared_loop.event_loop);
+	g_backend.run(shared_loop.native);
+
+	// Writes plus one batch read.
+	loop_stats_stop(&g_stats);
+	loop_stats_print(0, &g_stats, NULL, counter.count + 1);
+	g_backend.destroy(shared_loop.native);
 	as_event_destroy_loops();
 }
 
@@ -260,19 +273,8 @@ batch_listener(as_error* err, as_batch_read_records* records, void* udata, as_ev
 	close_aerospike(event_loop);
 }
 
-static void
-destroy_aerospike(void* udata)
-{
-	as_event_loop* event_loop = udata;
-
-	as_error err;
-	aerospike_close(&as, &err);
-	aerospike_destroy(&as);
-	as_event_close_loop(event_loop);
-}
-
 static void
 close_aerospike(as_event_loop* event_loop)
 {
-	as_event_loop_close_aerospike(event_loop, &as, destroy_aerospike, event_loop);
+	g_backend.close_aerospike(event_loop, &as);
 }
@@ -0,0 +1,176 @@
+#include "stats.h"
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// How often an idle server checks for stop, and how long a client gets to
+// send its request.
+#define STATS_POLL_MS 200
+
+#ifdef MSG_NOSIGNAL
+#define STATS_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define STATS_SEND_FLAGS 0
+#endif
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static bool
+send_all(int fd, const char* p, size_t size)
+{
+	while (size > 0) {
+		ssize_t n = send(fd, p, size, STATS_SEND_FLAGS);
+
+		if (n <= 0) {
+			// Scraper went away.
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static void
+remove_socket(const char* path)
+{
+	// Only a socket left by an earlier run is removed, never another file.
+	struct stat st;
+
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		unlink(path);
+	}
+}
+
+static void
+serve(stats_server* s, int fd)
+{
+#ifdef SO_NOSIGPIPE
+	// Platforms without MSG_NOSIGNAL.
+	int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	char request[1024];
+	ssize_t n = 0;
+
+	if (poll(&pfd, 1, STATS_POLL_MS) > 0) {
+		n = recv(fd, request, sizeof(request), 0);
+	}
+
+	char* body = NULL;
+	size_t size = 0;
+	FILE* out = open_memstream(&body, &size);
+
+	if (! out) {
+		return;
+	}
+	s->write(out, s->udata);
+	fclose(out);
+
+	if (n >= 4 && memcmp(request, "GET ", 4) == 0) {
+		char header[160];
+		int len = snprintf(header, sizeof(header),
+			"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", size);
+
+		if (! send_all(fd, header, len)) {
+			free(body);
+			return;
+		}
+	}
+	send_all(fd, body, size);
+	free(body);
+}
+
+static void*
+server_thread(void* udata)
+{
+	stats_server* s = udata;
+	struct pollfd pfd = {.fd = s->fd, .events = POLLIN};
+
+	while (! __atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+		if (poll(&pfd, 1, STATS_POLL_MS) <= 0) {
+			continue;
+		}
+
+		int fd = accept(s->fd, NULL, NULL);
+
+		if (fd < 0) {
+			continue;
+		}
+		serve(s, fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+bool
+stats_server_start(stats_server* s, const char* path, stats_write write, void* udata)
+{
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		return false;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	s->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (s->fd < 0) {
+		return false;
+	}
+
+	remove_socket(path);
+
+	if (bind(s->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(s->fd, 16) != 0) {
+		close(s->fd);
+		return false;
+	}
+
+	s->path = path;
+	s->stop = 0;
+	s->write = write;
+	s->udata = udata;
+
+	if (pthread_create(&s->thread, NULL, server_thread, s) != 0) {
+		close(s->fd);
+		remove_socket(path);
+		return false;
+	}
+	return true;
+}
+
+void
+stats_server_stop(stats_server* s)
+{
+	__atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(s->thread, NULL);
+	close(s->fd);
+	remove_socket(s->path);
+}
+
+void
+stats_family(FILE* out, const char* name, const char* type, const char* help)
+{
+	fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void
+stats_sample(FILE* out, const char* name, const char* labels, uint64_t value)
+{
+	fprintf(out, "%s{%s} %llu\n", name, labels, (unsigned long long)value);
+}
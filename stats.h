@@ -0,0 +1,64 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+// Error counts are kept per status code in a fixed array, so counting an
+// error is a single increment. Codes outside the range share the last slot.
+#define STATS_CODE_MIN (-32)
+#define STATS_CODE_MAX 255
+#define STATS_CODES (STATS_CODE_MAX - STATS_CODE_MIN + 2)
+
+// Renders every metric in Prometheus text format. Called on the server thread.
+typedef void (*stats_write)(FILE* out, void* udata);
+
+// Scrape endpoint on a Unix domain socket. Each connection gets one
+// rendering of the metrics and is closed. A request starting with "GET "
+// (curl --unix-socket, or Prometheus through a socket proxy) gets an HTTP
+// response, anything else gets the bare text, so nc -U works too.
+//
+// The server never takes a lock that a loop thread takes. The write callback
+// reads the loops' counters with plain aligned loads.
+typedef struct {
+	const char* path;
+	int fd;
+	uint32_t stop;
+	pthread_t thread;
+	stats_write write;
+	void* udata;
+} stats_server;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+bool stats_server_start(stats_server* s, const char* path, stats_write write, void* udata);
+
+// Joins the server thread and removes the socket file.
+void stats_server_stop(stats_server* s);
+
+// Write the HELP and TYPE lines of a metric family.
+void stats_family(FILE* out, const char* name, const char* type, const char* help);
+
+// Write one sample. labels is the inside of the braces, e.g. loop="0".
+void stats_sample(FILE* out, const char* name, const char* labels, uint64_t value);
+
+static inline uint32_t
+stats_code_slot(int code)
+{
+	return code >= STATS_CODE_MIN && code <= STATS_CODE_MAX ? (uint32_t)(code - STATS_CODE_MIN) : STATS_CODES - 1;
+}
+
+// Returns false for the shared slot of out of range codes.
+static inline bool
+stats_slot_code(uint32_t slot, int* code)
+{
+	*code = (int)slot + STATS_CODE_MIN;
+	return slot < STATS_CODES - 1;
+}
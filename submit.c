@@ -0,0 +1,120 @@
+#include "submit.h"
+#include <stdlib.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static inline bool
+head_ready(submit_queue* q)
+{
+	submit_cell* cell = &q->cells[q->head & q->mask];
+	return __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) == q->head + 1;
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+bool
+submit_queue_init(submit_queue* q, uint32_t capacity, void (*notify)(void* notifier), void* notifier)
+{
+	uint64_t size = 2;
+
+	while (size < capacity) {
+		size <<= 1;
+	}
+
+	if (posix_memalign((void**)&q->cells, SUBMIT_CACHE_LINE, sizeof(submit_cell) * size) != 0) {
+		return false;
+	}
+
+	// Cell i is free for the push at position i.
+	for (uint64_t i = 0; i < size; i++) {
+		q->cells[i].sequence = i;
+	}
+
+	q->mask = size - 1;
+	q->notify = notify;
+	q->notifier = notifier;
+	q->head = 0;
+	q->tail = 0;
+	q->wake_pending = 0;
+	return true;
+}
+
+void
+submit_queue_destroy(submit_queue* q)
+{
+	free(q->cells);
+}
+
+bool
+submit_queue_push(submit_queue* q, const submit_desc* desc)
+{
+	uint64_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	submit_cell* cell;
+
+	while (true) {
+		cell = &q->cells[pos & q->mask];
+
+		uint64_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+		int64_t diff = (int64_t)(seq - pos);
+
+		if (diff == 0) {
+			// Cell is free. Claim it, or retry from the tail another producer moved.
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			// Consumer has not freed the cell from the previous lap.
+			return false;
+		}
+		else {
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	// Publish.
+	cell->desc = *desc;
+	__atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+	// The publish must be visible before wake_pending is read, or a consumer
+	// rearming at the same time could miss this command and nobody wakes it.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&q->wake_pending, __ATOMIC_RELAXED) == 0 &&
+		__atomic_exchange_n(&q->wake_pending, 1, __ATOMIC_ACQ_REL) == 0) {
+		q->notify(q->notifier);
+	}
+	return true;
+}
+
+uint32_t
+submit_queue_pop(submit_queue* q, submit_desc* out, uint32_t max)
+{
+	uint32_t n = 0;
+
+	while (n < max && head_ready(q)) {
+		submit_cell* cell = &q->cells[q->head & q->mask];
+
+		out[n++] = cell->desc;
+
+		// Free the cell for the push one lap later.
+		__atomic_store_n(&cell->sequence, q->head + q->mask + 1, __ATOMIC_RELEASE);
+		q->head++;
+	}
+	return n;
+}
+
+bool
+submit_queue_rearm(submit_queue* q)
+{
+	__atomic_store_n(&q->wake_pending, 0, __ATOMIC_RELAXED);
+
+	// Pairs with the fence in push: either the producer sees the cleared flag
+	// and sends a wakeup, or this sees its command.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	return head_ready(q);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+#define SUBMIT_CACHE_LINE 64
+
+typedef enum {
+	SUBMIT_WRITE,
+	SUBMIT_READ
+} submit_op;
+
+// Command submitted by an application thread.
+typedef struct {
+	int64_t id;         // Key.
+	uint64_t enqueued;  // Enqueue time in nanoseconds.
+	submit_op op;
+} submit_desc;
+
+typedef struct {
+	uint64_t sequence;
+	submit_desc desc;
+} submit_cell;
+
+// Bounded lock-free ring with many producer threads and one consumer, the
+// event loop that owns it. Each cell carries a sequence number, so producers
+// only contend on a compare-and-swap of tail and never wait on the consumer
+// (Vyukov's bounded queue).
+//
+// Wakeups are coalesced. The first push into a ring the loop has drained
+// sends one wakeup, and no other push sends another until the loop has
+// drained the ring empty again.
+typedef struct {
+	submit_cell* cells;
+	uint64_t mask;
+	void (*notify)(void* notifier);
+	void* notifier;
+	uint64_t head __attribute__((aligned(SUBMIT_CACHE_LINE)));  // Consumer only.
+	uint64_t tail __attribute__((aligned(SUBMIT_CACHE_LINE)));  // Producers.
+	uint32_t wake_pending __attribute__((aligned(SUBMIT_CACHE_LINE)));
+} submit_queue;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Capacity is rounded up to a power of two. notify(notifier) must be safe to
+// call from any thread.
+bool submit_queue_init(submit_queue* q, uint32_t capacity, void (*notify)(void* notifier), void* notifier);
+
+void submit_queue_destroy(submit_queue* q);
+
+// Producer side. Returns false if the ring is full.
+bool submit_queue_push(submit_queue* q, const submit_desc* desc);
+
+// Consumer side. Pop up to max commands in enqueue order.
+uint32_t submit_queue_pop(submit_queue* q, submit_desc* out, uint32_t max);
+
+// Consumer side, once pop has found the ring empty. Lets the next push send a
+// wakeup again, and returns true if a push slipped in first, in which case
+// the caller should pop again.
+bool submit_queue_rearm(submit_queue* q);
@@ -0,0 +1,192 @@
+#include "value.h"
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_orderedmap.h>
+#include <aerospike/as_string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static const char* value_type_names[] = {"int", "string", "bytes", "list", "map"};
+
+static bool
+parse_type(const char* name, size_t len, value_type* type)
+{
+	for (uint32_t i = 0; i < sizeof(value_type_names) / sizeof(value_type_names[0]); i++) {
+		if (strlen(value_type_names[i]) == len && strncmp(value_type_names[i], name, len) == 0) {
+			*type = (value_type)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+bool
+value_spec_parse(value_spec* spec, const char* str)
+{
+	const char* p = strchr(str, ':');
+	size_t len = p ? (size_t)(p - str) : strlen(str);
+
+	spec->size_type = DISTRIBUTION_FIXED;
+	spec->min_size = 8;
+	spec->max_size = 8;
+
+	if (! parse_type(str, len, &spec->type)) {
+		return false;
+	}
+
+	if (! p) {
+		return true;
+	}
+
+	char* end;
+	spec->min_size = (uint32_t)strtoul(p + 1, &end, 10);
+	spec->max_size = spec->min_size;
+
+	if (end == p + 1) {
+		return false;
+	}
+
+	if (*end == '-') {
+		p = end + 1;
+		spec->max_size = (uint32_t)strtoul(p, &end, 10);
+
+		if (end == p || spec->max_size < spec->min_size) {
+			return false;
+		}
+		spec->size_type = DISTRIBUTION_UNIFORM;
+	}
+
+	if (*end == ':') {
+		if (! distribution_parse_type(end + 1, &spec->size_type)) {
+			return false;
+		}
+	}
+	else if (*end) {
+		return false;
+	}
+	return true;
+}
+
+void
+value_spec_print(const value_spec* spec, char* buf, size_t size)
+{
+	if (spec->type == VALUE_INT) {
+		snprintf(buf, size, "%s", value_type_names[spec->type]);
+	}
+	else if (spec->min_size == spec->max_size) {
+		snprintf(buf, size, "%s:%u", value_type_names[spec->type], spec->min_size);
+	}
+	else {
+		snprintf(buf, size, "%s:%u-%u:%s", value_type_names[spec->type], spec->min_size,
+			spec->max_size, distribution_type_name(spec->size_type));
+	}
+}
+
+bool
+value_arena_init(value_arena* arena, const value_spec* spec, uint32_t count)
+{
+	memset(arena, 0, sizeof(value_arena));
+	arena->spec = *spec;
+
+	if (spec->type == VALUE_INT) {
+		// Integer values are derived from the record id.
+		return true;
+	}
+
+	distribution size;
+	distribution_init(&size, spec->size_type, spec->min_size, spec->max_size);
+
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	uint32_t* sizes = malloc(sizeof(uint32_t) * count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		sizes[i] = (uint32_t)distribution_next(&size, &seed);
+		arena->data_size += sizes[i] + 1;
+	}
+
+	arena->count = count;
+	arena->values = calloc(count, sizeof(as_val*));
+
+	if (spec->type == VALUE_STRING || spec->type == VALUE_BYTES) {
+		// One contiguous block holds every value. Strings are null terminated.
+		arena->data = malloc(arena->data_size);
+
+		if (! arena->data) {
+			free(sizes);
+			free(arena->values);
+			return false;
+		}
+
+		uint8_t* p = arena->data;
+
+		for (uint32_t i = 0; i < count; i++) {
+			for (uint32_t j = 0; j < sizes[i]; j++) {
+				p[j] = spec->type == VALUE_STRING ?
+					(uint8_t)('a' + random_next(&seed) % 26) : (uint8_t)random_next(&seed);
+			}
+			p[sizes[i]] = 0;
+
+			if (spec->type == VALUE_STRING) {
+				arena->values[i] = (as_val*)as_string_new_wlen((char*)p, sizes[i], false);
+			}
+			else {
+				arena->values[i] = (as_val*)as_bytes_new_wrap(p, sizes[i], false);
+			}
+			p += sizes[i] + 1;
+		}
+	}
+	else {
+		for (uint32_t i = 0; i < count; i++) {
+			if (spec->type == VALUE_LIST) {
+				as_arraylist* list = as_arraylist_new(sizes[i], 0);
+
+				for (uint32_t j = 0; j < sizes[i]; j++) {
+					as_arraylist_append_int64(list, (int64_t)random_next(&seed));
+				}
+				arena->values[i] = (as_val*)list;
+			}
+			else {
+				as_orderedmap* map = as_orderedmap_new(sizes[i]);
+
+				for (uint32_t j = 0; j < sizes[i]; j++) {
+					as_orderedmap_set(map, (as_val*)as_integer_new(j), (as_val*)as_integer_new((int64_t)random_next(&seed)));
+				}
+				arena->values[i] = (as_val*)map;
+			}
+		}
+		// List/map elements are 64-bit integers.
+		arena->data_size *= 8;
+	}
+	free(sizes);
+	return true;
+}
+
+void
+value_arena_destroy(value_arena* arena)
+{
+	for (uint32_t i = 0; i < arena->count; i++) {
+		as_val_destroy(arena->values[i]);
+	}
+	free(arena->values);
+	free(arena->data);
+}
+
+uint64_t
+value_arena_avg_size(const value_arena* arena)
+{
+	if (arena->spec.type == VALUE_INT) {
+		return 8;
+	}
+	// data_size includes one terminator per value.
+	return arena->data_size / arena->count - (arena->spec.type == VALUE_STRING || arena->spec.type == VALUE_BYTES);
+}
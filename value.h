@@ -0,0 +1,99 @@
+#pragma once
+
+#include <aerospike/as_record.h>
+#include "distribution.h"
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+typedef enum {
+	VALUE_INT,
+	VALUE_STRING,
+	VALUE_BYTES,
+	VALUE_LIST,
+	VALUE_MAP
+} value_type;
+
+// Bin value layout. Size is in bytes for string/bytes values and in elements
+// for list/map values. Integer values ignore size.
+typedef struct {
+	value_type type;
+	distribution_type size_type;
+	uint32_t min_size;
+	uint32_t max_size;
+} value_spec;
+
+// Values are generated once at startup and shared read-only by all event
+// loops, so building a record on the hot path is only pointer assignment.
+typedef struct {
+	value_spec spec;
+	uint32_t count;
+	as_val** values;
+	uint8_t* data;       // Backing memory for string/bytes values.
+	uint64_t data_size;
+} value_arena;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Parse "<type>[:<size>[-<max_size>][:fixed|uniform|zipf]]", for example
+// "int", "string:100", "bytes:1024-16384:zipf" or "list:10".
+bool value_spec_parse(value_spec* spec, const char* str);
+
+// Print spec in parseable form.
+void value_spec_print(const value_spec* spec, char* buf, size_t size);
+
+bool value_arena_init(value_arena* arena, const value_spec* spec, uint32_t count);
+void value_arena_destroy(value_arena* arena);
+
+// Average generated value size in bytes (approximate for list/map).
+uint64_t value_arena_avg_size(const value_arena* arena);
+
+// Payload bytes of the value for record id. List and map values count the
+// arena average.
+static inline uint32_t
+value_arena_value_size(const value_arena* arena, uint64_t id)
+{
+	switch (arena->spec.type) {
+		case VALUE_INT:
+			return 8;
+		case VALUE_STRING:
+			return (uint32_t)as_string_len((as_string*)arena->values[id % arena->count]);
+		case VALUE_BYTES:
+			return as_bytes_size((as_bytes*)arena->values[id % arena->count]);
+		default:
+			return (uint32_t)value_arena_avg_size(arena);
+	}
+}
+
+// Set bin to value for record id. Values are not copied, so the record does
+// not need to be destroyed.
+static inline void
+value_arena_set_bin(const value_arena* arena, as_record* rec, const char* name, uint64_t id)
+{
+	if (arena->spec.type == VALUE_INT) {
+		as_record_set_int64(rec, name, (int64_t)id);
+		return;
+	}
+
+	as_val* val = arena->values[id % arena->count];
+
+	switch (arena->spec.type) {
+		case VALUE_STRING:
+			as_record_set_string(rec, name, (as_string*)val);
+			break;
+		case VALUE_BYTES:
+			as_record_set_bytes(rec, name, (as_bytes*)val);
+			break;
+		case VALUE_LIST:
+			as_record_set_list(rec, name, (as_list*)val);
+			break;
+		case VALUE_MAP:
+			as_record_set_map(rec, name, (as_map*)val);
+			break;
+		default:
+			break;
+	}
+}
@@ -0,0 +1,101 @@
+#include "warm_up.h"
+#include <aerospike/aerospike_key.h>
+#include <stdlib.h>
+
+/******************************************************************************
+ *	Static Functions
+ *****************************************************************************/
+
+static void issue_wave(warm_up* w);
+
+static void
+command_done(warm_up* w)
+{
+	if (--w->inflight > 0) {
+		return;
+	}
+
+	if (w->wave == 0) {
+		// Every connection is open. Measure the same reads without connects.
+		w->end = histogram_now();
+		w->wave = 1;
+		issue_wave(w);
+		return;
+	}
+	w->done(w->udata);
+}
+
+static void
+warm_up_listener(as_error* err, as_record* record, void* udata, as_event_loop* event_loop)
+{
+	warm_up_slot* slot = udata;
+	warm_up* w = slot->warm_up;
+
+	if (err && err->code != AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+		w->errors++;
+	}
+	else {
+		histogram_add(w->wave == 0 ? &w->cold : &w->warm, histogram_now() - slot->begin);
+	}
+	command_done(w);
+}
+
+static void
+issue_wave(warm_up* w)
+{
+	// Count the whole wave up front, so commands that fail to queue can not
+	// end it early.
+	w->inflight = w->count;
+
+	for (uint32_t i = 0; i < w->count; i++) {
+		warm_up_slot* slot = &w->slots[i];
+		as_key key;
+		as_error err;
+
+		// Keys need not exist. Not found still takes a connection and a round trip.
+		as_key_init_int64(&key, w->ns, w->set, w->keys[i]);
+		slot->begin = histogram_now();
+
+		if (aerospike_key_exists_async(w->as, &err, NULL, &key, warm_up_listener, slot, w->event_loop, NULL) != AEROSPIKE_OK) {
+			w->errors++;
+			command_done(w);
+		}
+	}
+}
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void
+warm_up_start(warm_up* w, aerospike* as, as_event_loop* event_loop, const char* ns, const char* set,
+	const int64_t* keys, uint32_t count, warm_up_callback done, void* udata)
+{
+	w->as = as;
+	w->event_loop = event_loop;
+	w->ns = ns;
+	w->set = set;
+	w->slots = malloc(sizeof(warm_up_slot) * count);
+	w->keys = keys;
+	w->count = count;
+	w->inflight = 0;
+	w->wave = 0;
+	w->errors = 0;
+	w->done = done;
+	w->udata = udata;
+	histogram_init(&w->cold);
+	histogram_init(&w->warm);
+
+	for (uint32_t i = 0; i < count; i++) {
+		w->slots[i].warm_up = w;
+	}
+
+	w->begin = histogram_now();
+	issue_wave(w);
+}
+
+void
+warm_up_destroy(warm_up* w)
+{
+	free(w->slots);
+}
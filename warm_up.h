@@ -0,0 +1,55 @@
+#pragma once
+
+#include <aerospike/aerospike.h>
+#include <aerospike/as_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "histogram.h"
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+typedef void (*warm_up_callback)(void* udata);
+
+// Per-command warm-up state.
+typedef struct {
+	struct warm_up_s* warm_up;
+	uint64_t begin;
+} warm_up_slot;
+
+// Connection warm-up for one event loop. The first wave sends count
+// concurrent reads of the given keys, so the client opens a connection for
+// each one, and their latency includes the connect. The second wave sends the same
+// reads again over the now open connections, giving the baseline that the
+// connect cost adds to.
+typedef struct warm_up_s {
+	aerospike* as;
+	as_event_loop* event_loop;
+	const char* ns;
+	const char* set;
+	warm_up_slot* slots;
+	const int64_t* keys;  // Key of each command. Caller owned.
+	uint32_t count;       // Commands per wave.
+	uint32_t inflight;
+	uint32_t wave;
+	uint64_t begin;       // First wave start.
+	uint64_t end;         // First wave end.
+	uint64_t errors;
+	histogram cold;       // First wave latency.
+	histogram warm;       // Second wave latency.
+	warm_up_callback done;
+	void* udata;
+} warm_up;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+// Start warm-up. Must be called from the event loop's thread. done is called
+// from that thread once both waves have completed. keys must stay valid until
+// then.
+void warm_up_start(warm_up* w, aerospike* as, as_event_loop* event_loop, const char* ns, const char* set,
+	const int64_t* keys, uint32_t count, warm_up_callback done, void* udata);
+
+void warm_up_destroy(warm_up* w);
@@ -0,0 +1,70 @@
+#include "window.h"
+#include <math.h>
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void
+window_init(window* w, uint32_t size, uint32_t min, uint32_t max, uint64_t target)
+{
+	w->target = target;
+	w->min = min;
+	w->max = max;
+	w->size = size < min ? min : size > max ? max : size;
+	w->samples = 0;
+	w->errors = 0;
+	w->latency_sum = 0;
+	w->rounds = 0;
+	w->avg_size = w->size;
+}
+
+uint32_t
+window_update(window* w, uint64_t latency, bool error)
+{
+	if (error) {
+		w->errors++;
+	}
+	else {
+		w->samples++;
+		w->latency_sum += latency;
+	}
+
+	if (w->samples + w->errors < w->size) {
+		return w->size;
+	}
+
+	// End of round.
+	double size = w->size;
+
+	if (w->errors > 0 || w->samples == 0) {
+		size /= 2;
+	}
+	else {
+		double avg = (double)w->latency_sum / w->samples;
+		double gradient = w->target / avg;
+
+		if (gradient < 0.5) {
+			gradient = 0.5;
+		}
+		else if (gradient > 1.0) {
+			gradient = 1.0;
+		}
+		size = size * gradient + sqrt(size);
+	}
+
+	if (size < w->min) {
+		size = w->min;
+	}
+	else if (size > w->max) {
+		size = w->max;
+	}
+
+	w->size = (uint32_t)size;
+	w->samples = 0;
+	w->errors = 0;
+	w->latency_sum = 0;
+	w->rounds++;
+	w->avg_size = w->avg_size * 0.9 + w->size * 0.1;
+	return w->size;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	Types
+ *****************************************************************************/
+
+// Adaptive in-flight window. The window is adjusted once per round, where a
+// round is one window's worth of completions. Like TCP Vegas, the window is
+// scaled by the gradient between the latency target and the observed average
+// latency, plus a small headroom that keeps probing for more throughput.
+// Errors halve the window.
+typedef struct {
+	uint64_t target;       // Latency target in nanoseconds.
+	uint32_t min;
+	uint32_t max;
+	uint32_t size;         // Current window.
+	uint32_t samples;      // Successful completions this round.
+	uint32_t errors;       // Errors this round.
+	uint64_t latency_sum;  // Latency sum of successful completions this round.
+	uint64_t rounds;
+	double avg_size;       // Exponential moving average of window size.
+} window;
+
+/******************************************************************************
+ *	Functions
+ *****************************************************************************/
+
+void window_init(window* w, uint32_t size, uint32_t min, uint32_t max, uint64_t target);
+
+// Record one completion and return the current window size.
+uint32_t window_update(window* w, uint64_t latency, bool error);